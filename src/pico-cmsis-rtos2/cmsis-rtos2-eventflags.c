@@ -64,7 +64,6 @@ osEventFlagsId_t osEventFlagsNew(const osEventFlagsAttr_t *attr)
 	new_eventflags->attr_bits = attr->attr_bits | (new_eventflags != attr->cb_mem ? osDynamicAlloc : 0);
 	new_eventflags->flags = 0;
 	new_eventflags->waiters = 0;
-	scheduler_futex_init(&new_eventflags->futex, (long *)&new_eventflags->flags, 0);
 	list_init(&new_eventflags->resource_node);
 
 	/* Add the new eventflags to the resource list */
@@ -114,7 +113,7 @@ uint32_t osEventFlagsSet(osEventFlagsId_t ef_id, uint32_t flags)
 	/* Run the algo */
 	uint32_t prev_flags = atomic_fetch_or(&eventflags->flags, flags);
 	if ((prev_flags & flags) != flags) {
-		int status = scheduler_futex_wake(&eventflags->futex, true);
+		int status = scheduler_futex_wake_addr((long *)&eventflags->flags, true);
 		if (status < 0)
 			return osFlagsError;
 		prev_flags |= flags;
@@ -204,7 +203,7 @@ uint32_t osEventFlagsWait(osEventFlagsId_t ef_id, uint32_t flags, uint32_t optio
 		}
 
 		/* Nope wait for the flags */
-		int status = scheduler_futex_wait(&eventflags->futex, prev_flags, timeout);
+		int status = scheduler_futex_wait_addr((long *)&eventflags->flags, prev_flags, timeout);
 		if (status < 0) {
 			--eventflags->waiters;
 			return status == -ETIMEDOUT || status == -ECANCELED ? osErrorTimeout : osError;
@@ -11,6 +11,7 @@
  *      Author: Stephen Street (stephen@redrocketcomputing.com)
  */
 
+#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
 
@@ -55,11 +56,12 @@ osStatus_t osDelayUntil (uint32_t ticks)
 	if (os_status != osOK)
 		return os_status;
 
-	/* Get calculate the number of ticks to sleep */
-	uint32_t msecs = ticks - scheduler_get_ticks();
+	/* Extend the wrapping deadline around the current time, a passed deadline only yields */
+	unsigned long long now = scheduler_get_ticks64();
+	unsigned long long deadline = now + (int32_t)(ticks - (uint32_t)now);
 
-	/* Forward, tick and msec are treated the same */
-	int status = scheduler_sleep(msecs);
+	/* Forward, the deadline stays absolute so periodic callers do not drift */
+	int status = scheduler_sleep_until(deadline);
 	if (status < 0)
 		return osError;
 
@@ -67,3 +69,96 @@ osStatus_t osDelayUntil (uint32_t ticks)
 	return osOK;
 
 }
+
+static osStatus_t osWaitAnyPrepare(const osWaitAnyItem_t *item, struct futex_waitv *waiter)
+{
+	/* Semaphores are ready with a token, they only sleep on an empty count */
+	if (osIsResourceValid(item->object_id, RTOS_SEMAPHORE_MARKER) == osOK) {
+		struct rtos_semaphore *semaphore = item->object_id;
+		waiter->addr = (long *)&semaphore->value;
+		waiter->value = 0;
+		return atomic_load(&semaphore->value) > 0 ? osOK : osErrorResource;
+	}
+
+	/* Message queues are ready with a message, the count is the data available semaphore */
+	if (osIsResourceValid(item->object_id, RTOS_MESSAGE_QUEUE_MARKER) == osOK) {
+		struct rtos_message_queue *queue = item->object_id;
+		waiter->addr = (long *)&queue->data_available.value;
+		waiter->value = 0;
+		return atomic_load(&queue->data_available.value) > 0 ? osOK : osErrorResource;
+	}
+
+	/* Event flags are ready when the flags match the options, any change of the flags is a wake up */
+	if (osIsResourceValid(item->object_id, RTOS_EVENTFLAGS_MARKER) == osOK) {
+		struct rtos_eventflags *eventflags = item->object_id;
+		if (item->flags == 0 || (item->flags & osFlagsError))
+			return osErrorParameter;
+
+		long flags = atomic_load(&eventflags->flags);
+		if (flags & osFlagsError)
+			return osError;
+
+		waiter->addr = (long *)&eventflags->flags;
+		waiter->value = flags;
+		if (item->options & osFlagsWaitAll)
+			return (flags & item->flags) == item->flags ? osOK : osErrorResource;
+		return (flags & item->flags) != 0 ? osOK : osErrorResource;
+	}
+
+	/* Not something we can wait on */
+	return osErrorParameter;
+}
+
+static void osWaitAnyTrack(const osWaitAnyItem_t *items, uint32_t count, long delta)
+{
+	/* Event flags can not be deleted with waiters */
+	for (uint32_t i = 0; i < count; ++i)
+		if (osIsResourceValid(items[i].object_id, RTOS_EVENTFLAGS_MARKER) == osOK)
+			atomic_fetch_add(&((struct rtos_eventflags *)items[i].object_id)->waiters, delta);
+}
+
+int32_t osWaitAny(const osWaitAnyItem_t *items, uint32_t count, uint32_t timeout)
+{
+	/* Polling is fine in an interrupt */
+	osStatus_t os_status = osKernelContextIsValid(true, timeout);
+	if (os_status != osOK)
+		return os_status;
+
+	/* The scheduler bounds the number of addresses in a vectored wait */
+	if (!items || count == 0 || count > SCHEDULER_FUTEX_WAITV_MAX)
+		return osErrorParameter;
+
+	/* The timeout is for the whole call, not for each wait */
+	unsigned long long deadline = scheduler_get_ticks64() + timeout;
+	struct futex_waitv waiters[SCHEDULER_FUTEX_WAITV_MAX];
+
+	osWaitAnyTrack(items, count, 1);
+	do {
+		/* Snapshot every object, the first ready one wins */
+		for (uint32_t i = 0; i < count; ++i) {
+			os_status = osWaitAnyPrepare(&items[i], &waiters[i]);
+			if (os_status == osOK) {
+				osWaitAnyTrack(items, count, -1);
+				return i;
+			}
+			if (os_status != osErrorResource) {
+				osWaitAnyTrack(items, count, -1);
+				return os_status;
+			}
+		}
+
+		/* Try semantics? */
+		if (timeout == 0) {
+			osWaitAnyTrack(items, count, -1);
+			return osErrorResource;
+		}
+
+		/* Sleep until any of them changes, a change before we got there just goes around again */
+		int status = timeout == osWaitForever ? scheduler_futex_waitv(waiters, count, SCHEDULER_WAIT_FOREVER) : scheduler_futex_waitv_until(waiters, count, deadline);
+		if (status < 0 && status != -EAGAIN) {
+			osWaitAnyTrack(items, count, -1);
+			return status == -ETIMEDOUT || status == -ECANCELED ? osErrorTimeout : osError;
+		}
+
+	} while (true);
+}
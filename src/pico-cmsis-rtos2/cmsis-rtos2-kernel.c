@@ -19,6 +19,8 @@
 
 #include <pico/toolkit/compiler.h>
 
+#include <hardware/timer.h>
+
 #include <cmsis/cmsis-rtos2.h>
 
 struct rtos_kernel *rtos2_kernel = 0;
@@ -126,10 +128,9 @@ osStatus_t osKernelGetInfo(osVersion_t *version, char *id_buf, uint32_t id_size)
 		version->kernel = 02001003;
 	}
 
-	if (id_buf != 0) {
+	/* A zero sized buffer gets nothing, not even the terminator */
+	if (id_buf != 0 && id_size != 0)
 		snprintf(id_buf, id_size, "rtos-toolkit");
-		id_buf[id_size - 1] = 0;
-	}
 
 	return osOK;
 }
@@ -249,11 +250,13 @@ uint32_t osKernelSuspend(void)
 	if (rtos2_kernel->state == osKernelSuspended)
 		return 0;
 
-	/* Change the state */
+	/* Change the state and stop scheduling */
 	rtos2_kernel->state = osKernelSuspended;
+	scheduler_lock();
 
-	/* For now */
-	return osWaitForever;
+	/* Report how long we can sleep until the next timeout */
+	unsigned long sleep_ticks = scheduler_idle_ticks();
+	return sleep_ticks == SCHEDULER_WAIT_FOREVER ? osWaitForever : sleep_ticks;
 }
 
 void osKernelResume(uint32_t sleep_ticks)
@@ -263,7 +266,13 @@ void osKernelResume(uint32_t sleep_ticks)
 	if (os_status != osOK)
 		return;
 
+	/* Only resume if suspended */
+	if (rtos2_kernel->state != osKernelSuspended)
+		return;
+
+	/* Both the SysTick and the tickless timer keep counting while we sleep, so the ticks are already correct */
 	rtos2_kernel->state = osKernelRunning;
+	scheduler_unlock();
 }
 
 uint32_t osKernelGetTickCount(void)
@@ -271,6 +280,25 @@ uint32_t osKernelGetTickCount(void)
 	return scheduler_get_ticks();
 }
 
+uint64_t osKernelGetIdleTime(uint32_t core)
+{
+	/* Microseconds */
+	struct core_stats stats;
+	if (osKernelContextIsValid(false, 0) != osOK || scheduler_get_core_stats(core, &stats) < 0)
+		return 0;
+
+	return stats.idle_time;
+}
+
+uint32_t osKernelGetSwitchCount(uint32_t core)
+{
+	struct core_stats stats;
+	if (osKernelContextIsValid(false, 0) != osOK || scheduler_get_core_stats(core, &stats) < 0)
+		return 0;
+
+	return stats.switches;
+}
+
 uint32_t osKernelGetTickFreq(void)
 {
 	return SCHEDULER_TICK_FREQ;
@@ -278,14 +306,23 @@ uint32_t osKernelGetTickFreq(void)
 
 uint32_t osKernelGetSysTimerCount(void)
 {
+#if SCHEDULER_TICKLESS
+	/* No SysTick in tickless mode, use the microsecond timer */
+	return time_us_32();
+#else
 	uint32_t load = SysTick->LOAD;
 	uint32_t sys_ticks = load - SysTick->VAL;
 	return sys_ticks + osKernelGetTickCount() * (load + 1);
+#endif
 }
 
 uint32_t osKernelGetSysTimerFreq(void)
 {
+#if SCHEDULER_TICKLESS
+	return 1000000UL;
+#else
 	return SystemCoreClock;
+#endif
 }
 
 void osCallOnce(osOnceFlagId_t once_flag, osOnceFunc_t func, void *context)
@@ -294,18 +331,14 @@ void osCallOnce(osOnceFlagId_t once_flag, osOnceFunc_t func, void *context)
 	if (atomic_load(once_flag) == 2)
 		return;
 
-	/* Setup a futex to wait on */
-	struct futex futex;
-	scheduler_futex_init(&futex, (long *)once_flag, 0);
-
 	/* Try to claim the initializer */
-	int expected = 0;
+	long expected = 0;
 	if (!atomic_compare_exchange_strong(once_flag, &expected, 1)) {
 
 		/* Wait on the futex */
 		expected = 2;
 		while (!atomic_compare_exchange_strong(once_flag, &expected, 2)) {
-			scheduler_futex_wait(&futex, expected, SCHEDULER_WAIT_FOREVER);
+			scheduler_futex_wait_addr((long *)once_flag, expected, SCHEDULER_WAIT_FOREVER);
 			expected = 2;
 		}
 
@@ -320,7 +353,7 @@ void osCallOnce(osOnceFlagId_t once_flag, osOnceFunc_t func, void *context)
 	atomic_store(once_flag, 2);
 
 	/* Wake any waiters */
-	scheduler_futex_wake(&futex, true);
+	scheduler_futex_wake_addr((long *)once_flag, true);
 }
 
 osStatus_t osKernelResourceAdd(osResourceId_t resource_id, osResourceNode_t node)
@@ -430,7 +463,7 @@ static osStatus_t osKernelDumpResource(osResource_t resource, void *context)
 		case RTOS_THREAD_MARKER:
 		{
 			struct rtos_thread *thread = resource;
-			fprintf(stdout, "thread: %p name: %s, state: %d stack available: %lu\n", thread, osThreadGetName(thread), osThreadGetState(thread), osThreadGetStackSpace(thread));
+			fprintf(stdout, "thread: %p name: %s, state: %d stack available: %lu run time: %llu us\n", thread, osThreadGetName(thread), osThreadGetState(thread), osThreadGetStackSpace(thread), osThreadGetRunTime(thread));
 			break;
 		}
 
@@ -64,7 +64,6 @@ osSemaphoreId_t osSemaphoreNew(uint32_t max_count, uint32_t initial_count, const
 	new_semaphore->attr_bits = attr->attr_bits | (new_semaphore != attr->cb_mem ? osDynamicAlloc : 0);
 	new_semaphore->max_count = max_count;
 	new_semaphore->value = initial_count;
-	scheduler_futex_init(&new_semaphore->futex, (long *)&new_semaphore->value, 0);
 	list_init(&new_semaphore->resource_node);
 
 	/* Add the new semaphore to the resource list */
@@ -115,7 +114,7 @@ osStatus_t osSemaphoreAcquire(osSemaphoreId_t semaphore_id, uint32_t timeout)
 	/* Run the acquire algo, this is tricky, the happy path does 2 compare exchanges,
 	 * The first checks to zero and the second decrements the counter, the whole thing
 	 * depends on the how expected is handled */
-	uint32_t expected = 1;
+	long expected = 1;
 	while (!atomic_compare_exchange_weak(&semaphore->value, &expected, expected - 1)) {
 
 		/* No resources */
@@ -126,7 +125,7 @@ osStatus_t osSemaphoreAcquire(osSemaphoreId_t semaphore_id, uint32_t timeout)
 				return osErrorResource;
 
 			/* We need to wait */
-			int status = scheduler_futex_wait(&semaphore->futex, 0, timeout);
+			int status = scheduler_futex_wait_addr((long *)&semaphore->value, 0, timeout);
 			if (status < 0)
 				return status == -ETIMEDOUT || status == -ECANCELED ? osErrorTimeout : osError;
 
@@ -158,12 +157,44 @@ osStatus_t osSemaphoreRelease(osSemaphoreId_t semaphore_id)
 
 	/* Run the algo */
     if (atomic_fetch_add(&semaphore->value, 1) == 0)
-		scheduler_futex_wake(&semaphore->futex, false);
+		scheduler_futex_wake_addr((long *)&semaphore->value, false);
 
     /* Looks good */
     return osOK;
 }
 
+osStatus_t osSemaphoreReleaseN(osSemaphoreId_t semaphore_id, uint32_t count)
+{
+	/* Validate the context */
+	osStatus_t os_status = osKernelContextIsValid(true, 0);
+	if (os_status != osOK)
+		return os_status;
+
+	/* Validate the semaphore */
+	os_status = osIsResourceValid(semaphore_id, RTOS_SEMAPHORE_MARKER);
+	if (os_status != osOK)
+		return os_status;
+	struct rtos_semaphore *semaphore = semaphore_id;
+
+	/* Nothing to release */
+	if (count == 0)
+		return osErrorParameter;
+
+	/* Add all the tokens at once, but only if they fit */
+	long expected = semaphore->value;
+	do {
+		if (count > semaphore->max_count - expected)
+			return osErrorResource;
+	} while (!atomic_compare_exchange_weak(&semaphore->value, &expected, expected + count));
+
+	/* Waiters only sleep on an empty semaphore, wake one per token in a single call */
+	if (expected == 0)
+		scheduler_futex_wake_addr_n((long *)&semaphore->value, count);
+
+	/* Looks good */
+	return osOK;
+}
+
 uint32_t osSemaphoreGetCount(osSemaphoreId_t semaphore_id)
 {
 	/* Validate the context */
@@ -65,6 +65,15 @@ __weak void _rtos2_release_thread(struct rtos_thread *thread)
 	_rtos2_release(thread);
 }
 
+static void osThreadRelease(struct rtos_thread *thread)
+{
+	/* Pooled threads go back to their pool, otherwise only release memory we allocated */
+	if (thread->attr_bits & osThreadPooled)
+		scheduler_task_pool_release(thread->pool, thread);
+	else if (thread->attr_bits & osDynamicAlloc)
+		_rtos2_release_thread(thread);
+}
+
 __weak void _rtos2_thread_stack_overflow(struct rtos_thread *thread)
 {
 	fprintf(stderr, "stack overflow: %s %p\n", thread->name, thread);
@@ -200,8 +209,7 @@ static void osThreadReaper(void *context)
 					thread->marker = 0;
 
 					/* Are we managing the memory? */
-					if (thread->attr_bits & osDynamicAlloc)
-						_rtos2_release_thread(thread);
+					osThreadRelease(thread);
 				}
 			}
 		}
@@ -245,7 +253,7 @@ static void osSchedulerTaskExitHandler(struct task *task)
 	struct rtos_thread *thread = task->context;
 
 	/* Check for overflow */
-	if (task->psp->r0 == (uint32_t)-EFAULT)
+	if (task->psp->r0 == (uintptr_t)-EFAULT)
 		_rtos2_thread_stack_overflow(thread);
 
 	/* Joinable? */
@@ -267,7 +275,7 @@ static void osSchedulerTaskExitHandler(struct task *task)
 		abort();
 }
 
-osThreadId_t osThreadNew(osThreadFunc_t func, void *argument, const osThreadAttr_t *attr)
+static osThreadId_t osThreadCreate(osThreadFunc_t func, void *argument, const osThreadAttr_t *attr, struct task_pool *pool)
 {
 	const osThreadAttr_t default_attr = { .stack_size = RTOS_DEFAULT_STACK_SIZE, .priority = osPriorityNormal };
 
@@ -291,7 +299,26 @@ osThreadId_t osThreadNew(osThreadFunc_t func, void *argument, const osThreadAttr
 	/* Setup the thread memory */
 	struct rtos_thread *new_thread = 0;
 	size_t stack_size = 0;
-	if (!attr->cb_mem && !attr->stack_mem) {
+	if (pool) {
+
+		/* The pool provides both the thread and the stack */
+		if (pool->marker != SCHEDULER_TASK_POOL_MARKER || attr->cb_mem || attr->stack_mem)
+			return 0;
+
+		/* Same layout as the dynamic allocation */
+		stack_size = osThreadMinimumStackSize + (attr->stack_size == 0 ? RTOS_DEFAULT_STACK_SIZE : attr->stack_size);
+		new_thread = scheduler_task_pool_alloc(pool, sizeof(struct rtos_thread) + stack_size);
+		if (!new_thread)
+			return 0;
+
+		/* Initialize the pointers */
+		new_thread->stack = new_thread->stack_area;
+		new_thread->stack_size = attr->stack_size == 0 ? RTOS_DEFAULT_STACK_SIZE : attr->stack_size;
+		new_thread->attr_bits = attr->attr_bits | osThreadPooled;
+		new_thread->pool = pool;
+
+	/* Dynamic allocation */
+	} else if (!attr->cb_mem && !attr->stack_mem) {
 
 		/* We will need more room on the stack for book keeping */
 		stack_size = osThreadMinimumStackSize + (attr->stack_size == 0 ? RTOS_DEFAULT_STACK_SIZE : attr->stack_size);
@@ -326,8 +353,9 @@ osThreadId_t osThreadNew(osThreadFunc_t func, void *argument, const osThreadAttr
 	} else
 		return 0;
 
-	/* Initialize the remain parts of the thread */
+	/* Initialize the remain parts of the thread, recycled memory is not cleared */
 	strncpy(new_thread->name, (attr->name ? attr->name : ""), RTOS_NAME_SIZE - 1);
+	new_thread->name[RTOS_NAME_SIZE - 1] = 0;
 	new_thread->marker = RTOS_THREAD_MARKER;
 	new_thread->func = func;
 	new_thread->context = argument;
@@ -350,6 +378,7 @@ osThreadId_t osThreadNew(osThreadFunc_t func, void *argument, const osThreadAttr
 	desc.context = new_thread;
 	desc.flags = SCHEDULER_TASK_STACK_CHECK | ((attr->attr_bits & osThreadCreateSuspended) ? SCHEDULER_CREATE_SUSPENDED : 0);
 	desc.priority = osSchedulerPriority(attr->priority == osPriorityNone ? osPriorityNormal : attr->priority);
+	desc.quantum = 0;
 
 	/* Add it to the kernel thread resource list */
 	os_status = osKernelResourceAdd(osResourceThread, &new_thread->resource_node);
@@ -373,13 +402,37 @@ delete_flags:
 	osEventFlagsDelete(&new_thread->flags);
 
 delete_thread:
-	if (new_thread->attr_bits & osDynamicAlloc)
-		_rtos2_release_thread(new_thread);
+	osThreadRelease(new_thread);
 
 	/* The big fail */
 	return 0;
 }
 
+osThreadId_t osThreadNew(osThreadFunc_t func, void *argument, const osThreadAttr_t *attr)
+{
+	/* Only a control block without a size can be a pool, osThreadNewPooled() is the way to pass one */
+	if (attr && (attr->attr_bits & osThreadPooled)) {
+
+		if (!attr->cb_mem || attr->cb_size != 0)
+			return 0;
+
+		osThreadAttr_t pooled_attr = *attr;
+		pooled_attr.cb_mem = 0;
+		return osThreadCreate(func, argument, &pooled_attr, attr->cb_mem);
+	}
+
+	return osThreadCreate(func, argument, attr, 0);
+}
+
+osThreadId_t osThreadNewPooled(osThreadFunc_t func, void *argument, const osThreadAttr_t *attr, struct task_pool *pool)
+{
+	/* Bail if no pool provided */
+	if (!pool)
+		return 0;
+
+	return osThreadCreate(func, argument, attr, pool);
+}
+
 const char *osThreadGetName(osThreadId_t thread_id)
 {
 	/* Check the thread id is provided */
@@ -476,21 +529,58 @@ uint32_t osThreadGetStackSpace(osThreadId_t thread_id)
 	if (os_status != osOK)
 		return 0;
 	struct rtos_thread *thread = thread_id;
-	struct task *task = thread->stack;
 
-	/* Lock the kernel so we the thread does not change */
-	osKernelLock();
-	uint32_t *current_pos = task->stack_marker;
-	while (current_pos < task->stack_marker + (thread->stack_size / 4)) {
-		if (*current_pos != SCHEDULER_STACK_MARKER)
-			break;
-		++current_pos;
-	}
-	osKernelUnlock();
+	/* Return the unused stack from the watermark maintained by the scheduler, the bookkeeping slack is not the callers */
+	size_t space = scheduler_get_stack_space(thread->stack);
+	return space < thread->stack_size ? space : thread->stack_size;
+}
+
+static osStatus_t osThreadGetStats(osThreadId_t thread_id, struct task_stats *stats)
+{
+	/* This would be bad */
+	osStatus_t os_status = osKernelContextIsValid(false, 0);
+	if (os_status != osOK)
+		return os_status;
 
-	/* Return the unused stack */
-	uint32_t unused_stack = (current_pos - task->stack_marker) * 4;
-	return unused_stack;
+	/* Validate the thread */
+	os_status = osIsResourceValid(thread_id, RTOS_THREAD_MARKER);
+	if (os_status != osOK)
+		return os_status;
+	struct rtos_thread *thread = thread_id;
+
+	/* Snapshot the counters */
+	if (scheduler_get_task_stats(thread->stack, stats) < 0)
+		return osErrorResource;
+
+	return osOK;
+}
+
+uint64_t osThreadGetRunTime(osThreadId_t thread_id)
+{
+	struct task_stats stats;
+	if (osThreadGetStats(thread_id, &stats) != osOK)
+		return 0;
+
+	/* Microseconds */
+	return stats.run_time;
+}
+
+uint32_t osThreadGetVoluntarySwitches(osThreadId_t thread_id)
+{
+	struct task_stats stats;
+	if (osThreadGetStats(thread_id, &stats) != osOK)
+		return 0;
+
+	return stats.voluntary_switches;
+}
+
+uint32_t osThreadGetPreemptedSwitches(osThreadId_t thread_id)
+{
+	struct task_stats stats;
+	if (osThreadGetStats(thread_id, &stats) != osOK)
+		return 0;
+
+	return stats.preempted_switches;
 }
 
 osStatus_t osThreadSetPriority(osThreadId_t thread_id, osPriority_t priority)
@@ -519,6 +609,28 @@ osStatus_t osThreadSetPriority(osThreadId_t thread_id, osPriority_t priority)
 	return osOK;
 }
 
+osStatus_t osThreadSetQuantum(osThreadId_t thread_id, uint32_t ticks)
+{
+	/* This would be bad */
+	osStatus_t os_status = osKernelContextIsValid(false, 0);
+	if (os_status != osOK)
+		return osErrorISR;
+
+	/* Validate the thread */
+	os_status = osIsResourceValid(thread_id, RTOS_THREAD_MARKER);
+	if (os_status != osOK)
+		return os_status;
+	struct rtos_thread *thread = thread_id;
+
+	/* Forward, zero is the kernel default */
+	int status = scheduler_set_quantum(thread->stack, ticks);
+	if (status < 0)
+		return osError;
+
+	/* All done here */
+	return osOK;
+}
+
 osPriority_t osThreadGetPriority(osThreadId_t thread_id)
 {
 	/* This would be bad */
@@ -735,8 +847,7 @@ osStatus_t osThreadJoin(osThreadId_t thread_id)
 	thread->marker = 0;
 
 	/* Are we managing the memory? */
-	if (thread->attr_bits & osDynamicAlloc)
-		_rtos2_release_thread(thread);
+	osThreadRelease(thread);
 
 	/* We own the terminating thread clean up */
 	return osOK;
@@ -25,6 +25,7 @@ extern __weak struct rtos_timer *_rtos2_alloc_timer(void);
 extern __weak void _rtos2_release_timer(struct rtos_timer *timer);
 
 void scheduler_tick_hook(unsigned long ticks);
+unsigned long scheduler_tick_delay_hook(unsigned long ticks);
 
 static osMessageQueueId_t timer_queue;
 static osThreadId_t timer_thread;
@@ -79,6 +80,21 @@ void scheduler_tick_hook(unsigned long ticks)
 	}
 }
 
+unsigned long scheduler_tick_delay_hook(unsigned long ticks)
+{
+	unsigned long delay = SCHEDULER_WAIT_FOREVER;
+
+	/* Ticks until the first timer target, this keeps the tick hook running in tickless mode */
+	uint32_t state = spin_lock_irqsave(&active_timers_lock);
+	if (!list_is_empty(&active_timers)) {
+		uint32_t target = list_first_entry(&active_timers, struct rtos_timer, node)->target;
+		delay = (int32_t)(target - ticks) > 0 ? target - ticks : 0;
+	}
+	spin_unlock_irqrestore(&active_timers_lock, state);
+
+	return delay;
+}
+
 static void osTimerThread(void *context)
 {
 	struct rtos_timer *timer;
@@ -218,8 +234,13 @@ osStatus_t osTimerStart (osTimerId_t timer_id, uint32_t ticks)
 		if (timer->target < current->target)
 			break;
 	list_insert_before(&current->node, &timer->node);
+	bool first = list_first_entry(&active_timers, struct rtos_timer, node) == timer;
 	spin_unlock_irqrestore(&active_timers_lock, state);
 
+	/* In tickless mode the first core runs the timers, make it program the earlier wake up */
+	if (SCHEDULER_TICKLESS && first)
+		scheduler_request_switch(0);
+
 	/* All good */
 	return osOK;
 }
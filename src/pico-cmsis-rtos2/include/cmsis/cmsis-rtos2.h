@@ -38,6 +38,7 @@
 #define osDynamicAlloc 0x80000000U
 #define osReapThread 0x40000000U
 #define osThreadCreateSuspended 0x20000000U
+#define osThreadPooled 0x10000000U
 
 #define RTOS_NAME_SIZE 32UL
 #define RTOS_DEFAULT_STACK_SIZE 1024UL
@@ -56,6 +57,13 @@ typedef osStatus_t (*osResouceNodeForEachFunc_t)(const osResource_t resource, vo
 
 typedef void *osDequeId_t;
 
+/* Semaphores and message queues are ready with a token or a message, event flags take the flags and options of osEventFlagsWait() */
+typedef struct {
+	void *object_id;
+	uint32_t flags;
+	uint32_t options;
+} osWaitAnyItem_t;
+
 typedef enum
 {
 	osResourceThread = 0,
@@ -88,8 +96,6 @@ struct rtos_eventflags
 
 	uint32_t attr_bits;
 
-	struct futex futex;
-
 	atomic_long waiters;
 	atomic_long flags;
 
@@ -118,10 +124,8 @@ struct rtos_semaphore
 
 	uint32_t attr_bits;
 
-	struct futex futex;
-
 	uint32_t max_count;
-	atomic_uint value;
+	atomic_long value;
 
 	struct linked_list resource_node;
 };
@@ -136,6 +140,7 @@ struct rtos_thread
 	void *context;
 	void *stack;
 	size_t stack_size;
+	struct task_pool *pool;
 
 	struct rtos_eventflags joiner;
 	struct rtos_eventflags flags;
@@ -332,7 +337,16 @@ static inline __always_inline __optimize osPriority_t osKernelPriority(uint32_t
 }
 
 osStatus_t osMemoryPoolIsBlockValid(osMemoryPoolId_t mp_id, void *block);
+uint64_t osThreadGetRunTime(osThreadId_t thread_id);
+uint32_t osThreadGetVoluntarySwitches(osThreadId_t thread_id);
+uint32_t osThreadGetPreemptedSwitches(osThreadId_t thread_id);
+osStatus_t osThreadSetQuantum(osThreadId_t thread_id, uint32_t ticks);
+osThreadId_t osThreadNewPooled(osThreadFunc_t func, void *argument, const osThreadAttr_t *attr, struct task_pool *pool);
+uint64_t osKernelGetIdleTime(uint32_t core);
+uint32_t osKernelGetSwitchCount(uint32_t core);
 void osTimerTick(void);
 osStatus_t osMutexRobustRelease(osMutexId_t mutex_id, osThreadId_t owner);
+osStatus_t osSemaphoreReleaseN(osSemaphoreId_t semaphore_id, uint32_t count);
+int32_t osWaitAny(const osWaitAnyItem_t *items, uint32_t count, uint32_t timeout);
 
 #endif
@@ -32,6 +32,10 @@ __weak void init_fault()
 {
 }
 
+__weak void identify_fault(struct cortexm_fault *fault)
+{
+}
+
 __weak void save_fault(const struct cortexm_fault *fault)
 {
 	struct backtrace *backtrace = cls_datum(fault_backtrace);
@@ -54,6 +58,10 @@ __weak void save_fault(const struct cortexm_fault *fault)
 	/* Print header */
 	fprintf(stderr, "\ncore %lu faulted at 0x%08lx with PSR 0x%08lx\n", fault->core, fault_pc, fault->PSR);
 
+	/* Report the task if the fault was identified */
+	if (fault->task != 0)
+		fprintf(stderr, "\ttask 0x%08lx%s\n", fault->task, fault->stack_overflow ? " overflowed its stack" : "");
+
 	/* Dump the registers first */
 	fprintf(stderr, "\tr0:  0x%08lx r1:  0x%08lx r2:  0x%08lx r3:  0x%08lx\n", fault->r0, fault->r1, fault->r2, fault->r3);
 	fprintf(stderr, "\tr4:  0x%08lx r5:  0x%08lx r6:  0x%08lx r7:  0x%08lx\n", fault->r4, fault->r5, fault->r6, fault->r7);
@@ -96,6 +104,8 @@ static __isr_section void assemble_cortexm_fault(struct cortexm_fault *fault, co
 	fault->fault_type = SCB->ICSR & SCB_ICSR_VECTACTIVE_Msk;
 	fault->exception_return = exception_return;
 	fault->core = get_core_num();
+	fault->task = 0;
+	fault->stack_overflow = 0;
 }
 
 __isr_section void hard_fault(const struct fault_frame *fault_frame, const struct callee_registers *callee_registers, uint32_t exception_return)
@@ -108,6 +118,9 @@ __isr_section void hard_fault(const struct fault_frame *fault_frame, const struc
 	/* Assemble the fault information */
 	assemble_cortexm_fault(&fault, fault_frame, callee_registers, exception_return);
 
+	/* Let the runtime attribute the fault */
+	identify_fault(&fault);
+
 	/* Save the fault information */
 	save_fault(&fault);
 
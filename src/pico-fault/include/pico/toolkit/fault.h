@@ -64,6 +64,8 @@ struct cortexm_fault
 	uint32_t fault_type;
 	uint32_t exception_return;
 	uint32_t core;
+	uint32_t task;
+	uint32_t stack_overflow;
 };
 
 extern void fault(const struct fault_frame *fault_frame, const struct callee_registers *callee_registers, uint32_t exception_return);
@@ -71,6 +73,7 @@ extern void hard_fault(const struct fault_frame *fault_frame, const struct calle
 
 /* These function allow the application to dump, save and continue from a fault */
 extern void init_fault(void);
+extern void identify_fault(struct cortexm_fault *fault);
 extern void save_fault(const struct cortexm_fault *fault);
 extern void reset_fault(const struct cortexm_fault *fault);
 
@@ -0,0 +1,511 @@
+/*
+ * Copyright (C) 2024 Stephen Street
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * host-glue.c
+ *
+ * Scheduler glue for the host port, standing in for scheduler-glue.c and the
+ * SVC and PendSV handlers. Service calls run on the calling stack, PendSV
+ * swaps ucontexts and a per core POSIX timer signal provides the SysTick.
+ */
+
+#define _GNU_SOURCE
+
+#include <assert.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <sys/mman.h>
+
+#if __has_include(<valgrind/valgrind.h>)
+#include <valgrind/valgrind.h>
+#define HOST_VALGRIND 1
+#endif
+
+#include <pico/toolkit/compiler.h>
+#include <pico/toolkit/cmsis.h>
+#include <pico/toolkit/scheduler.h>
+#include <pico/toolkit/tls.h>
+
+#include "host.h"
+
+#if SCHEDULER_TICKLESS
+#error "the host port only supports the periodic tick"
+#endif
+
+#if SCHEDULER_MPU_GUARD
+#error "the host port has no MPU"
+#endif
+
+#ifndef sigev_notify_thread_id
+#define sigev_notify_thread_id _sigev_un._tid
+#endif
+
+#ifndef PICO_HOST_STACK_SIZE
+#define PICO_HOST_STACK_SIZE (256 * 1024)
+#endif
+
+#define HOST_START_SVC 0
+#define HOST_FRAME_NEEDED 0x00000002UL
+
+extern uintptr_t scheduler_svc_vector[];
+extern struct scheduler_frame *scheduler_switch(struct scheduler_frame *frame, void *cls);
+extern core_local struct scheduler_frame *scheduler_initial_frame;
+
+extern __weak void multicore_startup_hook(void);
+extern __weak void multicore_shutdown_hook(void);
+
+void scheduler_switch_hook(struct task *task);
+void scheduler_tls_init_hook(void *tls);
+void scheduler_terminated_hook(struct task *task);
+void scheduler_idle_hook(void);
+void scheduler_startup_hook(void);
+void scheduler_shutdown_hook(void);
+void scheduler_spin_lock(void);
+void scheduler_spin_unlock(void);
+unsigned int scheduler_spin_lock_irqsave(void);
+void scheduler_spin_unlock_irqrestore(unsigned int state);
+void enable_debugger_support(void);
+
+struct host_core host_cores[SCHEDULER_MAX_CORES];
+
+static __thread struct host_core *host_current_core = 0;
+static atomic_flag host_lock = ATOMIC_FLAG_INIT;
+static pthread_once_t host_install_once = PTHREAD_ONCE_INIT;
+static sigset_t host_signals;
+static size_t host_stack_size = PICO_HOST_STACK_SIZE;
+
+/* Never inlined or analysed, a task can move to another host thread between two calls */
+__attribute__((noipa)) __section("host_nopreempt") struct host_core *host_self(void)
+{
+	return host_current_core;
+}
+
+__attribute__((noipa)) int host_errno(void)
+{
+	return errno;
+}
+
+__attribute__((noipa)) void host_set_errno(int value)
+{
+	errno = value;
+}
+
+void host_bind_core(unsigned long core)
+{
+	host_current_core = &host_cores[core];
+	_host_set_core(core);
+}
+
+void scheduler_spin_lock(void)
+{
+	while (atomic_flag_test_and_set_explicit(&host_lock, memory_order_acquire))
+		__WFE();
+}
+
+void scheduler_spin_unlock(void)
+{
+	atomic_flag_clear_explicit(&host_lock, memory_order_release);
+}
+
+unsigned int scheduler_spin_lock_irqsave(void)
+{
+	unsigned int state = disable_interrupts();
+	scheduler_spin_lock();
+	return state;
+}
+
+void scheduler_spin_unlock_irqrestore(unsigned int state)
+{
+	scheduler_spin_unlock();
+	enable_interrupts(state);
+}
+
+__host_nopreempt unsigned long scheduler_current_core(void)
+{
+	return host_self()->core;
+}
+
+__host_nopreempt void scheduler_request_switch(unsigned long core)
+{
+	/* Drop if kicking other cores */
+	if (core == UINT32_MAX)
+		return;
+
+	/* Pend the PendSV of the target core */
+	struct host_core *self = host_self();
+	struct host_core *target = &host_cores[core];
+	atomic_store(&target->pendsv, true);
+
+	/* Other cores need a kick, an offline core will find it when it starts */
+	if (target != self) {
+		if (atomic_load(&target->online))
+			pthread_kill(target->thread, HOST_KICK_SIGNAL);
+		return;
+	}
+
+	/* Like the hardware, thread mode takes the PendSV right away */
+	if (self->ipsr == HOST_THREAD_MODE && self->primask == 0)
+		host_exception_return(0, true);
+}
+
+__host_nopreempt int host_svc_call(uint8_t code, uintptr_t arg0, uintptr_t arg1, uintptr_t arg2, uintptr_t arg3)
+{
+	struct host_core *core = host_self();
+
+	/* The frame lives on the calling stack, just like the exception frame would */
+	struct host_frame frame =
+	{
+		.frame = { .exec_return = 0xfffffffd, .control = CONTROL_SPSEL_Msk, .r0 = arg0, .r1 = arg1, .r2 = arg2, .r3 = arg3 },
+		.context = core->running,
+	};
+
+	/* Take the SVC exception */
+	core->ipsr = HOST_SVC_EXCEPTION;
+
+	/* Starting saves the frame to return to on shutdown and runs the first task */
+	if (code == HOST_START_SVC) {
+		cls_datum(scheduler_initial_frame) = &frame.frame;
+		atomic_store(&core->pendsv, true);
+	} else {
+		uintptr_t handler = scheduler_svc_vector[code];
+		if (handler & HOST_FRAME_NEEDED)
+			((void (*)(struct scheduler_frame *))(handler & ~HOST_FRAME_NEEDED))(&frame.frame);
+		else
+			((void (*)(struct exception_frame *))handler)((struct exception_frame *)&frame.frame.r0);
+	}
+
+	/* Return through any pending interrupts and switches, the result may have been updated meanwhile */
+	host_exception_return(&frame, true);
+
+	return (int)frame.frame.r0;
+}
+
+static void host_context_destroy(struct host_context *context)
+{
+	/* The boot contexts use the stacks of the host threads */
+	if (!context->stack)
+		return;
+
+#if HOST_VALGRIND
+	VALGRIND_STACK_DEREGISTER(context->stack_id);
+#endif
+
+	munmap(context->stack, context->stack_size);
+}
+
+static void host_task_start(void)
+{
+	struct host_context *context = host_self()->running;
+
+	/* Leave the PendSV, the task may be preempted before it gets going */
+	host_exception_return(0, true);
+
+	/* Run the task, which exits through the scheduler */
+	context->entry_point(context->context);
+
+	/* Task entry points must never return */
+	abort();
+}
+
+static struct host_context *host_context_create(struct scheduler_frame *frame)
+{
+	size_t page_size = sysconf(_SC_PAGESIZE);
+	size_t stack_size = page_size + ((host_stack_size + page_size - 1) & ~(page_size - 1));
+
+	/* A mmap is safe in the signal handler and gives us a guard page */
+	void *stack = mmap(0, stack_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK, -1, 0);
+	if (stack == MAP_FAILED)
+		abort();
+	if (mprotect(stack, page_size, PROT_NONE) < 0)
+		abort();
+
+	/* The context sits at the top of its stack */
+	struct host_context *context = (struct host_context *)(((uintptr_t)stack + stack_size - sizeof(struct host_context)) & ~63UL);
+	memset(context, 0, sizeof(struct host_context));
+	atomic_init(&context->state, 0);
+	context->entry_point = (void (*)(void *))frame->pc;
+	context->context = (void *)frame->r0;
+	context->stack = stack;
+	context->stack_size = stack_size;
+	context->launch.context = context;
+
+	/* The task starts in thread mode with the host signals open */
+	if (getcontext(&context->ucontext) < 0)
+		abort();
+	context->ucontext.uc_stack.ss_sp = stack + page_size;
+	context->ucontext.uc_stack.ss_size = ((uintptr_t)context & ~15UL) - (uintptr_t)(stack + page_size);
+	context->ucontext.uc_link = 0;
+	for (int signo = SIGRTMIN; signo <= SIGRTMAX; ++signo)
+		if (sigismember(&host_signals, signo))
+			sigdelset(&context->ucontext.uc_sigmask, signo);
+	makecontext(&context->ucontext, host_task_start, 0);
+
+#if HOST_VALGRIND
+	context->stack_id = VALGRIND_STACK_REGISTER(context->ucontext.uc_stack.ss_sp, context->ucontext.uc_stack.ss_sp + context->ucontext.uc_stack.ss_size);
+#endif
+
+	return context;
+}
+
+static void host_pendsv_handler(void);
+
+static void host_handler_create(struct host_core *core)
+{
+	/* The switch runs on its own stack, this stands in for the main stack of the core */
+	void *stack = mmap(0, host_stack_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK, -1, 0);
+	if (stack == MAP_FAILED)
+		abort();
+
+	if (getcontext(&core->handler) < 0)
+		abort();
+	core->handler.uc_stack.ss_sp = stack;
+	core->handler.uc_stack.ss_size = host_stack_size;
+	core->handler.uc_link = 0;
+	makecontext(&core->handler, host_pendsv_handler, 0);
+
+#if HOST_VALGRIND
+	VALGRIND_STACK_REGISTER(stack, stack + host_stack_size);
+#endif
+}
+
+static void host_pendsv_handler(void)
+{
+	struct host_core *core = host_self();
+
+	/* Entered with the interrupted context saved, like the hardware PendSV on the main stack. Saving
+	 * before switching means a core never waits while holding an unsaved context, so two cores picking
+	 * each others tasks can not deadlock */
+	while (true) {
+
+		/* The saved context can run elsewhere now, a terminated task is reaped once we are off its stack */
+		struct host_context *previous = core->running;
+		bool dead = (atomic_fetch_and(&previous->state, ~HOST_CONTEXT_BUSY) & HOST_CONTEXT_DEAD) != 0;
+
+		/* Let the scheduler pick the next frame */
+		struct scheduler_frame *next = scheduler_switch(core->frame ? &core->frame->frame : 0, cls_ptr());
+		if (dead)
+			host_context_destroy(previous);
+
+		/* Frames built by scheduler_create have never run, the task gets a context now */
+		struct host_context *target;
+		if (next->psr == xPSR_T_Msk) {
+			target = host_context_create(next);
+			scheduler_task()->psp = &target->launch.frame;
+		} else
+			target = container_of(next, struct host_frame, frame)->context;
+
+		/* A task blocked by a service is published before its PendSV saves it, wait for the other core to get off its stack */
+		while (atomic_fetch_or(&target->state, HOST_CONTEXT_BUSY) & HOST_CONTEXT_BUSY)
+			sched_yield();
+
+		/* Run it, we come back here on the next switch of this core */
+		core->running = target;
+		swapcontext(&core->handler, &target->ucontext);
+	}
+}
+
+void host_pendsv(struct host_frame *frame)
+{
+	struct host_core *core = host_self();
+	struct host_context *self = core->running;
+	struct host_frame local;
+
+	/* A running task needs a frame, preempted tasks get one here */
+	core->frame = 0;
+	if (scheduler_task() != 0) {
+		if (!frame) {
+			local = (struct host_frame){ .frame = { .exec_return = 0xfffffffd, .control = CONTROL_SPSEL_Msk }, .context = self };
+			frame = &local;
+		}
+		core->frame = frame;
+	}
+
+	/* Save ourselves and switch on the handler stack, the errno of the host thread follows the task */
+	int saved_errno = host_errno();
+	swapcontext(&self->ucontext, &core->handler);
+	host_set_errno(saved_errno);
+}
+
+void scheduler_switch_hook(struct task *task)
+{
+	_set_tls(task != 0 ? task->tls : 0);
+}
+
+void scheduler_tls_init_hook(void *tls)
+{
+	_init_tls(tls);
+}
+
+__weak void scheduler_tick_hook(unsigned long ticks)
+{
+}
+
+void scheduler_terminated_hook(struct task *task)
+{
+	assert(task != 0 && task->marker == SCHEDULER_TASK_MARKER);
+
+	/* Find the context, tasks which never ran do not have one */
+	struct host_context *context = 0;
+	if (task == scheduler_task())
+		context = host_self()->running;
+	else if (task->psp && task->psp->psr != xPSR_T_Msk)
+		context = container_of(task->psp, struct host_frame, frame)->context;
+
+	/* The exit handler still needs the frame */
+	if (task->exit_handler)
+		task->exit_handler(task);
+
+	/* Reap the context now unless it is running, then the next switch does it */
+	if (context && (atomic_fetch_or(&context->state, HOST_CONTEXT_DEAD) & HOST_CONTEXT_BUSY) == 0)
+		host_context_destroy(context);
+}
+
+void scheduler_idle_hook(void)
+{
+	struct host_core *core = host_self();
+	sigset_t mask;
+	sigset_t idle_mask;
+
+	scheduler_spin_unlock();
+
+	/* Sleep until there is some work, checked with the signals blocked so no wake up is lost */
+	pthread_sigmask(SIG_BLOCK, &host_signals, &mask);
+	idle_mask = mask;
+	for (int signo = SIGRTMIN; signo <= SIGRTMAX; ++signo)
+		if (sigismember(&host_signals, signo))
+			sigdelset(&idle_mask, signo);
+	while (!host_interrupts_pending(core) && !atomic_load(&core->pendsv))
+		sigsuspend(&idle_mask);
+	pthread_sigmask(SIG_SETMASK, &mask, 0);
+
+	/* We are already inside the PendSV, take the interrupts here and drop the pended switch */
+	host_service_interrupts(core);
+	atomic_store(&core->pendsv, false);
+
+	scheduler_spin_lock();
+}
+
+static void SysTick_Handler(void)
+{
+	/* Clear the overflow */
+	__unused uint32_t value = SysTick->CTRL;
+
+	/* Forward the to the scheduler tick handler */
+	scheduler_tick();
+}
+
+static void host_install(void)
+{
+	/* Both signals run the interrupt emulation */
+	struct sigaction action;
+	memset(&action, 0, sizeof(action));
+	action.sa_sigaction = host_signal_handler;
+	action.sa_flags = SA_SIGINFO | SA_RESTART;
+	action.sa_mask = host_signals;
+	if (sigaction(HOST_TICK_SIGNAL, &action, 0) < 0 || sigaction(HOST_KICK_SIGNAL, &action, 0) < 0)
+		abort();
+
+	/* Install the SysTick handler, the load value is only informational */
+	host_vectors[HOST_SYSTICK_EXCEPTION] = (uintptr_t)SysTick_Handler;
+	SysTick->LOAD = (SystemCoreClock / SCHEDULER_TICK_FREQ) - 1UL;
+	SysTick->VAL = 0UL;
+	SysTick->CTRL = SysTick_CTRL_CLKSOURCE_Msk | SysTick_CTRL_TICKINT_Msk | SysTick_CTRL_ENABLE_Msk;
+}
+
+void scheduler_startup_hook(void)
+{
+	struct host_core *core = host_self();
+
+	/* Keep the signals out until this core is ready, host threads started from here inherit this */
+	pthread_sigmask(SIG_BLOCK, &host_signals, 0);
+
+	/* Set the rtos system exception priorities of this core */
+	NVIC_SetPriority(PendSV_IRQn, SCHEDULER_PENDSV_PRIORITY);
+	NVIC_SetPriority(SVCall_IRQn, SCHEDULER_SVC_PRIORITY);
+	NVIC_SetPriority(SysTick_IRQn, SCHEDULER_SYSTICK_PRIORITY);
+
+	/* The first core installs the signal handlers */
+	pthread_once(&host_install_once, host_install);
+
+	/* Each core gets a timer signalling its own host thread */
+	struct sigevent event;
+	memset(&event, 0, sizeof(event));
+	event.sigev_notify = SIGEV_THREAD_ID;
+	event.sigev_signo = HOST_TICK_SIGNAL;
+	event.sigev_notify_thread_id = gettid();
+	if (timer_create(CLOCK_MONOTONIC, &event, &core->timer) < 0)
+		abort();
+
+	struct itimerspec period = { .it_interval = { 0, 1000000000L / SCHEDULER_TICK_FREQ }, .it_value = { 0, 1000000000L / SCHEDULER_TICK_FREQ } };
+	if (timer_settime(core->timer, 0, &period, 0) < 0)
+		abort();
+
+	/* Now we can be kicked */
+	core->thread = pthread_self();
+	atomic_store(&core->online, true);
+
+	/* Optionally pass to the multicore hook */
+	if (multicore_startup_hook)
+		multicore_startup_hook();
+
+	pthread_sigmask(SIG_UNBLOCK, &host_signals, 0);
+}
+
+void scheduler_shutdown_hook(void)
+{
+	struct host_core *core = host_self();
+
+	/* Nothing switches on this core anymore */
+	pthread_sigmask(SIG_BLOCK, &host_signals, 0);
+	atomic_store(&core->online, false);
+	timer_delete(core->timer);
+	atomic_store(&core->pendsv, false);
+	atomic_store(&core->ticks_pending, 0);
+
+	/* Optionally pass to the multicore hook */
+	if (multicore_shutdown_hook)
+		multicore_shutdown_hook();
+}
+
+void enable_debugger_support(void)
+{
+}
+
+static __constructor_priority(102) void host_init(void)
+{
+	/* The signals used for the SysTick and the PendSV kick */
+	sigemptyset(&host_signals);
+	sigaddset(&host_signals, HOST_TICK_SIGNAL);
+	sigaddset(&host_signals, HOST_KICK_SIGNAL);
+
+	/* Task stacks are host sized, allow them to be tuned */
+	const char *stack_size = getenv("PICO_HOST_STACK_SIZE");
+	if (stack_size && strtoul(stack_size, 0, 0) >= 65536)
+		host_stack_size = strtoul(stack_size, 0, 0);
+
+	/* Every core starts in thread mode running on its host thread */
+	for (unsigned long core = 0; core < SCHEDULER_MAX_CORES; ++core) {
+		host_handler_create(&host_cores[core]);
+		host_cores[core].core = core;
+		host_cores[core].ipsr = HOST_THREAD_MODE;
+		host_cores[core].primask = 0;
+		host_cores[core].active_priority = HOST_THREAD_PRIORITY;
+		atomic_init(&host_cores[core].boot.state, HOST_CONTEXT_BUSY);
+		host_cores[core].boot.launch.context = &host_cores[core].boot;
+		host_cores[core].running = &host_cores[core].boot;
+	}
+
+	/* The main thread is core 0 */
+	host_bind_core(0);
+}
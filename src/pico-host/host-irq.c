@@ -0,0 +1,300 @@
+/*
+ * Copyright (C) 2024 Stephen Street
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * host-irq.c
+ *
+ * Exception emulation for the host port. Every core has an IPSR, a PRIMASK,
+ * a pending PendSV and a small NVIC. Interrupts raised by signals are only
+ * taken in thread mode with interrupts enabled, in handler mode they stay
+ * pending until the exception return, which is also where PendSV runs.
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <ucontext.h>
+
+#include <hardware/irq.h>
+
+#include <pico/toolkit/compiler.h>
+#include <pico/toolkit/cmsis.h>
+
+#include "host.h"
+
+extern char __executable_start[];
+extern char etext[];
+extern char __start_host_nopreempt[];
+extern char __stop_host_nopreempt[];
+
+SCB_Type host_scb = { .VTOR = (uintptr_t)host_vectors };
+SysTick_Type host_systick = { 0 };
+uint32_t SystemCoreClock = 125000000;
+
+uintptr_t host_vectors[HOST_NUM_VECTORS] = { 0 };
+
+static bool host_preemptible(void *ucontext)
+{
+	ucontext_t *uc = ucontext;
+
+#if defined(__x86_64__)
+	char *pc = (char *)uc->uc_mcontext.gregs[REG_RIP];
+#elif defined(__aarch64__)
+	char *pc = (char *)uc->uc_mcontext.pc;
+#else
+#error "unsupported host architecture"
+#endif
+
+	/* Only our own code is preempted, the host C library keeps its locks per host thread */
+	if (pc < __executable_start || pc >= etext)
+		return false;
+
+	/* And not while it is working on the state of the current core */
+	return pc < __start_host_nopreempt || pc >= __stop_host_nopreempt;
+}
+
+static int host_next_interrupt(struct host_core *core)
+{
+	int vector = -1;
+	uint32_t priority = core->active_priority;
+
+	/* Lower vectors win ties, so the tick goes first */
+	if (atomic_load(&core->ticks_pending) != 0 && host_vectors[HOST_SYSTICK_EXCEPTION] != 0 && core->priority[HOST_SYSTICK_EXCEPTION] < priority) {
+		vector = HOST_SYSTICK_EXCEPTION;
+		priority = core->priority[HOST_SYSTICK_EXCEPTION];
+	}
+
+	/* Then the enabled interrupts */
+	unsigned long pending = atomic_load(&core->irq_pending) & atomic_load(&core->irq_enabled);
+	while (pending != 0) {
+		int irq = __builtin_ctzl(pending);
+		pending &= pending - 1;
+		if (core->priority[HOST_IRQ_EXCEPTION + irq] < priority) {
+			vector = HOST_IRQ_EXCEPTION + irq;
+			priority = core->priority[vector];
+		}
+	}
+
+	return vector;
+}
+
+bool host_interrupts_pending(struct host_core *core)
+{
+	return host_next_interrupt(core) >= 0;
+}
+
+void host_service_interrupts(struct host_core *core)
+{
+	int vector;
+
+	/* Masked interrupts stay pending */
+	if (core->primask != 0)
+		return;
+
+	/* Take the interrupts which preempt the active priority, highest first */
+	while ((vector = host_next_interrupt(core)) >= 0) {
+
+		/* Acknowledge */
+		if (vector == HOST_SYSTICK_EXCEPTION)
+			atomic_fetch_sub(&core->ticks_pending, 1);
+		else
+			atomic_fetch_and(&core->irq_pending, ~(1UL << (vector - HOST_IRQ_EXCEPTION)));
+
+		/* Run the handler at its own priority */
+		uint32_t ipsr = core->ipsr;
+		uint32_t active_priority = core->active_priority;
+		core->ipsr = vector;
+		core->active_priority = core->priority[vector];
+		if (host_vectors[vector] != 0)
+			((void (*)(void))host_vectors[vector])();
+		core->ipsr = ipsr;
+		core->active_priority = active_priority;
+	}
+}
+
+__host_nopreempt void host_exception_return(struct host_frame *frame, bool preemptible)
+{
+	struct host_core *core = host_self();
+
+	/* Handle everything in handler mode */
+	if (core->ipsr == HOST_THREAD_MODE)
+		core->ipsr = HOST_PENDSV_EXCEPTION;
+
+	while (true) {
+
+		/* Interrupts first, they are likely to pend the switch */
+		host_service_interrupts(core);
+
+		/* Run the PendSV, we may come back on a different core */
+		if (preemptible && atomic_exchange(&core->pendsv, false)) {
+			core->ipsr = HOST_PENDSV_EXCEPTION;
+			host_pendsv(frame);
+			core = host_self();
+			continue;
+		}
+
+		/* Back to thread mode, unless something arrived while we were leaving */
+		core->ipsr = HOST_THREAD_MODE;
+		atomic_signal_fence(memory_order_seq_cst);
+		if (!host_interrupts_pending(core) && !(preemptible && atomic_load(&core->pendsv)))
+			return;
+		core->ipsr = HOST_PENDSV_EXCEPTION;
+	}
+}
+
+void host_signal_handler(int signo, siginfo_t *info, void *ucontext)
+{
+	int saved_errno = host_errno();
+	struct host_core *core = host_self();
+
+	/* Every expiry of the core timer is a SysTick, overruns are dropped so a woken task runs before the next tick */
+	if (signo == HOST_TICK_SIGNAL)
+		atomic_fetch_add(&core->ticks_pending, 1);
+
+	/* Interrupted thread mode takes the exception now, otherwise the exception return will */
+	if (core->ipsr == HOST_THREAD_MODE && core->primask == 0)
+		host_exception_return(0, host_preemptible(ucontext));
+
+	host_set_errno(saved_errno);
+}
+
+__host_nopreempt uint32_t __get_IPSR(void)
+{
+	return host_self()->ipsr;
+}
+
+__host_nopreempt uint32_t disable_interrupts(void)
+{
+	struct host_core *core = host_self();
+	uint32_t primask = core->primask;
+	core->primask = 1;
+	atomic_signal_fence(memory_order_seq_cst);
+	return primask;
+}
+
+__host_nopreempt void enable_interrupts(uint32_t primask)
+{
+	struct host_core *core = host_self();
+
+	atomic_signal_fence(memory_order_seq_cst);
+	core->primask = primask;
+	atomic_signal_fence(memory_order_seq_cst);
+
+	/* Take anything which became pending while masked */
+	if (primask != 0)
+		return;
+	if (core->ipsr == HOST_THREAD_MODE) {
+		if (host_interrupts_pending(core) || atomic_load(&core->pendsv))
+			host_exception_return(0, true);
+	} else
+		host_service_interrupts(core);
+}
+
+void __WFI(void)
+{
+	sched_yield();
+}
+
+void __WFE(void)
+{
+	sched_yield();
+}
+
+static inline unsigned int host_vector(IRQn_Type irq)
+{
+	return HOST_IRQ_EXCEPTION + irq;
+}
+
+__host_nopreempt void NVIC_SetPriority(IRQn_Type irq, uint32_t priority)
+{
+	host_self()->priority[host_vector(irq)] = (priority << (8U - __NVIC_PRIO_BITS)) & 0xff;
+}
+
+__host_nopreempt uint32_t NVIC_GetPriority(IRQn_Type irq)
+{
+	return host_self()->priority[host_vector(irq)] >> (8U - __NVIC_PRIO_BITS);
+}
+
+__host_nopreempt void NVIC_EnableIRQ(IRQn_Type irq)
+{
+	struct host_core *core = host_self();
+
+	atomic_fetch_or(&core->irq_enabled, 1UL << irq);
+
+	/* An already pending interrupt fires on enable */
+	if (core->primask == 0 && host_interrupts_pending(core)) {
+		if (core->ipsr == HOST_THREAD_MODE)
+			host_exception_return(0, true);
+		else
+			host_service_interrupts(core);
+	}
+}
+
+__host_nopreempt void NVIC_DisableIRQ(IRQn_Type irq)
+{
+	atomic_fetch_and(&host_self()->irq_enabled, ~(1UL << irq));
+}
+
+__host_nopreempt uint32_t NVIC_GetEnableIRQ(IRQn_Type irq)
+{
+	return (atomic_load(&host_self()->irq_enabled) >> irq) & 0x1;
+}
+
+__host_nopreempt void NVIC_SetPendingIRQ(IRQn_Type irq)
+{
+	struct host_core *core = host_self();
+
+	atomic_fetch_or(&core->irq_pending, 1UL << irq);
+
+	/* Software triggered interrupts are taken right away when they preempt */
+	if (core->primask == 0 && host_interrupts_pending(core)) {
+		if (core->ipsr == HOST_THREAD_MODE)
+			host_exception_return(0, true);
+		else
+			host_service_interrupts(core);
+	}
+}
+
+__host_nopreempt void NVIC_ClearPendingIRQ(IRQn_Type irq)
+{
+	atomic_fetch_and(&host_self()->irq_pending, ~(1UL << irq));
+}
+
+__host_nopreempt uint32_t NVIC_GetPendingIRQ(IRQn_Type irq)
+{
+	return (atomic_load(&host_self()->irq_pending) >> irq) & 0x1;
+}
+
+void irq_set_exclusive_handler(unsigned int num, irq_handler_t handler)
+{
+	host_vectors[HOST_IRQ_EXCEPTION + num] = (uintptr_t)handler;
+}
+
+irq_handler_t irq_get_exclusive_handler(unsigned int num)
+{
+	return (irq_handler_t)host_vectors[HOST_IRQ_EXCEPTION + num];
+}
+
+void irq_set_enabled(unsigned int num, bool enabled)
+{
+	if (enabled)
+		NVIC_EnableIRQ(num);
+	else
+		NVIC_DisableIRQ(num);
+}
+
+void irq_set_priority(unsigned int num, uint8_t priority)
+{
+	host_self()->priority[HOST_IRQ_EXCEPTION + num] = priority;
+}
+
+void irq_set_pending(unsigned int num)
+{
+	NVIC_SetPendingIRQ(num);
+}
@@ -0,0 +1,71 @@
+/*
+ * Copyright (C) 2024 Stephen Street
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * host-multicore.c
+ *
+ * Host stand in for multicore-glue.c, the extra cores are host threads
+ * launched from the startup hook of core 0.
+ */
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <pico/platform.h>
+
+#include <pico/toolkit/scheduler.h>
+
+#include "host.h"
+
+void multicore_startup_hook(void);
+void multicore_shutdown_hook(void);
+
+static atomic_ulong cores_started = 0;
+
+unsigned long scheduler_num_cores(void)
+{
+	return NUM_CORES;
+}
+
+static void *multicore_start(void *arg)
+{
+	/* This host thread is now the core */
+	host_bind_core((uintptr_t)arg);
+
+	/* This will capture the initial frame, we will return here when the scheduler exits */
+	scheduler_run();
+
+	return 0;
+}
+
+void multicore_startup_hook(void)
+{
+	/* If we are running on the startup core, launch the others */
+	if (scheduler_current_core() == 0) {
+
+		atomic_store(&cores_started, 0);
+		for (uintptr_t core = 1; core < NUM_CORES; ++core) {
+			pthread_t thread;
+			if (pthread_create(&thread, 0, multicore_start, (void *)core) != 0)
+				abort();
+			pthread_detach(thread);
+		}
+
+		/* Wait for them to start */
+		while (atomic_load(&cores_started) != NUM_CORES - 1)
+			sched_yield();
+
+	} else
+		/* Release the core zero startup */
+		atomic_fetch_add(&cores_started, 1);
+}
+
+void multicore_shutdown_hook(void)
+{
+}
@@ -0,0 +1,106 @@
+/*
+ * Copyright (C) 2024 Stephen Street
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * host.h
+ *
+ * Shared state of the host port. Each core is a host thread, its exception
+ * state is emulated in host-irq.c and the tasks are ucontexts switched by
+ * host-glue.c.
+ */
+
+#ifndef _HOST_H_
+#define _HOST_H_
+
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <time.h>
+#include <ucontext.h>
+
+#include <pico/toolkit/compiler.h>
+#include <pico/toolkit/cmsis.h>
+#include <pico/toolkit/scheduler.h>
+
+#define HOST_THREAD_MODE 0
+#define HOST_SVC_EXCEPTION 11
+#define HOST_PENDSV_EXCEPTION 14
+#define HOST_SYSTICK_EXCEPTION 15
+#define HOST_IRQ_EXCEPTION 16
+
+#define HOST_THREAD_PRIORITY 0x100
+
+#define HOST_TICK_SIGNAL (SIGRTMIN)
+#define HOST_KICK_SIGNAL (SIGRTMIN + 1)
+
+#define HOST_CONTEXT_BUSY 0x00000001UL
+#define HOST_CONTEXT_DEAD 0x00000002UL
+
+/* Code which reads and then updates the state of the current core can not be preempted */
+#define __host_nopreempt __attribute__((noinline)) __section("host_nopreempt")
+
+struct host_context;
+
+/* The scheduler only sees the frame, the host needs to know which context it belongs to */
+struct host_frame
+{
+	struct scheduler_frame frame;
+	struct host_context *context;
+};
+
+struct host_context
+{
+	ucontext_t ucontext;
+	atomic_ulong state;
+	void (*entry_point)(void *);
+	void *context;
+	void *stack;
+	size_t stack_size;
+	unsigned int stack_id;
+	struct host_frame launch;
+};
+
+struct host_core
+{
+	unsigned long core;
+	pthread_t thread;
+	timer_t timer;
+	atomic_bool online;
+
+	volatile uint32_t ipsr;
+	volatile uint32_t primask;
+	volatile uint32_t active_priority;
+	atomic_bool pendsv;
+	atomic_ulong ticks_pending;
+	atomic_ulong irq_pending;
+	atomic_ulong irq_enabled;
+	uint8_t priority[HOST_NUM_VECTORS];
+
+	ucontext_t handler;
+	struct host_frame *frame;
+	struct host_context boot;
+	struct host_context *running;
+};
+
+extern struct host_core host_cores[SCHEDULER_MAX_CORES];
+extern uintptr_t host_vectors[HOST_NUM_VECTORS];
+
+struct host_core *host_self(void);
+void host_bind_core(unsigned long core);
+
+int host_errno(void);
+void host_set_errno(int value);
+
+bool host_interrupts_pending(struct host_core *core);
+void host_service_interrupts(struct host_core *core);
+void host_exception_return(struct host_frame *frame, bool preemptible);
+void host_signal_handler(int signo, siginfo_t *info, void *ucontext);
+
+void host_pendsv(struct host_frame *frame);
+
+#endif
@@ -0,0 +1,29 @@
+/*
+ * Copyright (C) 2024 Stephen Street
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * errno.h
+ *
+ * Host version of the toolkit errno.h, adding the rtos error numbers to the
+ * host C library ones.
+ */
+
+#ifndef _HOST_ERRNO_H_
+#define _HOST_ERRNO_H_
+
+#include_next <errno.h>
+
+#ifndef __error_t_defined
+typedef int error_t;
+#define __error_t_defined 1
+#endif
+
+#define ERTOS 2001
+#define ERESOURCE (ERTOS + 2)
+
+extern error_t errno_from_rtos(int rtos);
+
+#endif
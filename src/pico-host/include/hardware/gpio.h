@@ -0,0 +1,25 @@
+/*
+ * Copyright (C) 2024 Stephen Street
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * gpio.h
+ *
+ * The host has no pins, the console goes to stdout.
+ */
+
+#ifndef _HARDWARE_GPIO_H_
+#define _HARDWARE_GPIO_H_
+
+enum gpio_function
+{
+	GPIO_FUNC_UART = 2,
+};
+
+static inline void gpio_set_function(unsigned int gpio, enum gpio_function fn)
+{
+}
+
+#endif
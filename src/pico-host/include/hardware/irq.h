@@ -0,0 +1,28 @@
+/*
+ * Copyright (C) 2024 Stephen Street
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * irq.h
+ *
+ * Host stand in for the pico-sdk interrupt API, the handlers go into the host vector table.
+ */
+
+#ifndef _HARDWARE_IRQ_H_
+#define _HARDWARE_IRQ_H_
+
+#include <stdbool.h>
+
+#include <pico/toolkit/cmsis.h>
+
+typedef void (*irq_handler_t)(void);
+
+void irq_set_exclusive_handler(unsigned int num, irq_handler_t handler);
+irq_handler_t irq_get_exclusive_handler(unsigned int num);
+void irq_set_enabled(unsigned int num, bool enabled);
+void irq_set_priority(unsigned int num, uint8_t priority);
+void irq_set_pending(unsigned int num);
+
+#endif
@@ -0,0 +1,26 @@
+/*
+ * Copyright (C) 2024 Stephen Street
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * timer.h
+ *
+ * Only the raw low word of the timer is used by the scheduler, it is read through a compound literal so no register block is needed.
+ */
+
+#ifndef _HARDWARE_STRUCTS_TIMER_H_
+#define _HARDWARE_STRUCTS_TIMER_H_
+
+#include <hardware/timer.h>
+
+typedef struct
+{
+	uint32_t timerawh;
+	uint32_t timerawl;
+} timer_hw_t;
+
+#define timer_hw (&(timer_hw_t){ .timerawl = time_us_32() })
+
+#endif
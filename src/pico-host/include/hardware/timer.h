@@ -0,0 +1,42 @@
+/*
+ * Copyright (C) 2024 Stephen Street
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * timer.h
+ *
+ * Host stand in for the pico-sdk microsecond timer, backed by the monotonic clock.
+ */
+
+#ifndef _HARDWARE_TIMER_H_
+#define _HARDWARE_TIMER_H_
+
+#include <stdint.h>
+#include <time.h>
+
+static inline uint64_t time_us_64(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec * 1000000ULL + now.tv_nsec / 1000;
+}
+
+static inline uint32_t time_us_32(void)
+{
+	return (uint32_t)time_us_64();
+}
+
+static inline void busy_wait_us(uint64_t delay_us)
+{
+	uint64_t start = time_us_64();
+	while (time_us_64() - start < delay_us);
+}
+
+static inline void busy_wait_us_32(uint32_t delay_us)
+{
+	busy_wait_us(delay_us);
+}
+
+#endif
@@ -0,0 +1,38 @@
+/*
+ * Copyright (C) 2024 Stephen Street
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * uart.h
+ *
+ * Host stand in for the pico-sdk UART, uart0 is stdin and stdout.
+ */
+
+#ifndef _HARDWARE_UART_H_
+#define _HARDWARE_UART_H_
+
+#include <stdio.h>
+
+typedef struct uart_inst uart_inst_t;
+
+#define uart0 ((uart_inst_t *)0)
+#define uart1 ((uart_inst_t *)1)
+
+static inline unsigned int uart_init(uart_inst_t *uart, unsigned int baudrate)
+{
+	return baudrate;
+}
+
+static inline void uart_putc(uart_inst_t *uart, char c)
+{
+	putchar(c);
+}
+
+static inline char uart_getc(uart_inst_t *uart)
+{
+	return getchar();
+}
+
+#endif
@@ -0,0 +1,29 @@
+/*
+ * Copyright (C) 2024 Stephen Street
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * platform.h
+ *
+ * Host stand in for the pico-sdk platform header.
+ */
+
+#ifndef _PICO_PLATFORM_H_
+#define _PICO_PLATFORM_H_
+
+#include <pico/toolkit/compiler.h>
+
+#ifndef NUM_CORES
+#define NUM_CORES 2
+#endif
+
+unsigned long scheduler_current_core(void);
+
+static inline unsigned int get_core_num(void)
+{
+	return scheduler_current_core();
+}
+
+#endif
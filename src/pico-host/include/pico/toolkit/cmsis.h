@@ -0,0 +1,144 @@
+/*
+ * Copyright (C) 2024 Stephen Street
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * cmsis.h
+ *
+ * Host replacement for the RP2040 CMSIS core. The exception state of each
+ * core lives in host-irq.c, the system control block and the SysTick are
+ * plain memory.
+ */
+
+#ifndef _CMSIS_H_
+#define _CMSIS_H_
+
+#include <stdint.h>
+#include <stdatomic.h>
+
+#include <pico/toolkit/compiler.h>
+
+#define __CORTEX_M 0U
+#define __NVIC_PRIO_BITS 2U
+
+#define HOST_NUM_IRQS 32
+#define HOST_NUM_VECTORS (16 + HOST_NUM_IRQS)
+
+typedef enum
+{
+	NonMaskableInt_IRQn = -14,
+	HardFault_IRQn = -13,
+	SVCall_IRQn = -5,
+	PendSV_IRQn = -2,
+	SysTick_IRQn = -1,
+} IRQn_Type;
+
+typedef struct
+{
+	volatile uint32_t CPUID;
+	volatile uint32_t ICSR;
+	volatile uintptr_t VTOR;
+	volatile uint32_t AIRCR;
+	volatile uint32_t SCR;
+	volatile uint32_t CCR;
+	volatile uint32_t SHPR[2];
+	volatile uint32_t SHCSR;
+} SCB_Type;
+
+typedef struct
+{
+	volatile uint32_t CTRL;
+	volatile uint32_t LOAD;
+	volatile uint32_t VAL;
+	volatile uint32_t CALIB;
+} SysTick_Type;
+
+#define SCB_ICSR_PENDSVSET_Msk (1UL << 28)
+#define SCB_ICSR_PENDSVCLR_Msk (1UL << 27)
+#define SCB_SCR_SEVONPEND_Msk (1UL << 4)
+
+#define SysTick_CTRL_COUNTFLAG_Msk (1UL << 16)
+#define SysTick_CTRL_CLKSOURCE_Msk (1UL << 2)
+#define SysTick_CTRL_TICKINT_Msk (1UL << 1)
+#define SysTick_CTRL_ENABLE_Msk (1UL << 0)
+
+#define CONTROL_SPSEL_Msk (1UL << 1)
+#define xPSR_T_Msk (1UL << 24)
+
+extern SCB_Type host_scb;
+extern SysTick_Type host_systick;
+extern uint32_t SystemCoreClock;
+
+#define SCB (&host_scb)
+#define SysTick (&host_systick)
+
+uint32_t __get_IPSR(void);
+uint32_t disable_interrupts(void);
+void enable_interrupts(uint32_t primask);
+
+void __WFI(void);
+void __WFE(void);
+
+void NVIC_SetPriority(IRQn_Type irq, uint32_t priority);
+uint32_t NVIC_GetPriority(IRQn_Type irq);
+void NVIC_EnableIRQ(IRQn_Type irq);
+void NVIC_DisableIRQ(IRQn_Type irq);
+uint32_t NVIC_GetEnableIRQ(IRQn_Type irq);
+void NVIC_SetPendingIRQ(IRQn_Type irq);
+void NVIC_ClearPendingIRQ(IRQn_Type irq);
+uint32_t NVIC_GetPendingIRQ(IRQn_Type irq);
+
+static inline uint32_t __get_PRIMASK(void)
+{
+	uint32_t primask = disable_interrupts();
+	enable_interrupts(primask);
+	return primask;
+}
+
+static inline void __set_PRIMASK(uint32_t primask)
+{
+	enable_interrupts(primask);
+}
+
+static inline void __disable_irq(void)
+{
+	(void)disable_interrupts();
+}
+
+static inline void __enable_irq(void)
+{
+	enable_interrupts(0);
+}
+
+/* Tasks run on their own host stacks, there is no process stack to measure */
+static inline uintptr_t __get_PSP(void)
+{
+	return UINTPTR_MAX;
+}
+
+static inline void __SEV(void)
+{
+}
+
+static inline void __NOP(void)
+{
+}
+
+static inline void __DMB(void)
+{
+	atomic_thread_fence(memory_order_seq_cst);
+}
+
+static inline void __DSB(void)
+{
+	atomic_thread_fence(memory_order_seq_cst);
+}
+
+static inline void __ISB(void)
+{
+	atomic_thread_fence(memory_order_seq_cst);
+}
+
+#endif
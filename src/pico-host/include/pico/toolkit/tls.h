@@ -0,0 +1,44 @@
+/*
+ * Copyright (C) 2024 Stephen Street
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * tls.h
+ *
+ * Host core local storage. The core data is gathered into a named section
+ * so the linker provides its bounds, each core gets a copy of it in tls.c.
+ */
+
+#ifndef _TLS_H_
+#define _TLS_H_
+
+#include <stddef.h>
+
+#ifndef thread_local
+#define	thread_local _Thread_local
+#endif
+
+#define core_local __section("core_data")
+
+#define cls_offset(datum) ({extern char __start_core_data[]; ((size_t)&datum - (size_t)&__start_core_data);})
+#define cls_ptr() ({extern void *__aeabi_read_cls(void);__aeabi_read_cls();})
+#define cls_core_ptr(core) ({extern void *__aeabi_read_core_cls(unsigned long);__aeabi_read_core_cls(core);})
+#define cls_datum_ptr(datum) ((typeof(datum) *)(cls_ptr() + cls_offset(datum)))
+#define cls_datum(datum) (*(cls_datum_ptr(datum)))
+#define cls_datum_at(cls, datum) (*((typeof(datum) *)((cls) + cls_offset(datum))))
+#define cls_datum_core_ptr(core, datum) ((typeof(datum) *)(cls_core_ptr(core) + cls_offset(datum)))
+#define cls_datum_core(core, datum) (*(cls_datum_core_ptr(core, datum)))
+
+extern void *__aeabi_read_core_cls(unsigned long core);
+extern void *__aeabi_read_cls(void);
+extern void *__aeabi_read_tp(void);
+
+extern void _init_tls(void *__tls);
+extern void _set_tls(void *tls);
+
+/* Bind the calling host thread to a core */
+extern void _host_set_core(unsigned long core);
+
+#endif
@@ -0,0 +1,23 @@
+/*
+ * Copyright (C) 2024 Stephen Street
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * picotls.h
+ *
+ * The host C library owns the thread local storage, tasks do not get a TLS block.
+ */
+
+#ifndef _PICOTLS_H_
+#define _PICOTLS_H_
+
+#include <stddef.h>
+
+static inline size_t _tls_size(void)
+{
+	return 0;
+}
+
+#endif
@@ -0,0 +1,72 @@
+/*
+ * Copyright (C) 2024 Stephen Street
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * tls.c
+ *
+ * Host core local storage. Task TLS is left to the host C library, tasks
+ * get no TLS block of their own so _set_tls() and _init_tls() do nothing.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <pico/toolkit/compiler.h>
+#include <pico/toolkit/scheduler.h>
+#include <pico/toolkit/tls.h>
+
+extern char __start_core_data[];
+extern char __stop_core_data[];
+
+/* Keeps the section alive even if nothing else is core local */
+static core_local __unused unsigned long core_data_anchor = 0;
+
+static void *core_blocks[SCHEDULER_MAX_CORES];
+static __thread void *core_block = 0;
+
+void *__aeabi_read_cls(void)
+{
+	return core_block;
+}
+
+void *__aeabi_read_core_cls(unsigned long core)
+{
+	return core_blocks[core];
+}
+
+void *__aeabi_read_tp(void)
+{
+	return 0;
+}
+
+void _set_tls(void *tls)
+{
+}
+
+void _init_tls(void *tls)
+{
+}
+
+void _host_set_core(unsigned long core)
+{
+	core_block = core_blocks[core];
+}
+
+static __constructor_priority(101) void _cls_init(void)
+{
+	size_t size = __stop_core_data - __start_core_data;
+
+	/* Load the core local blocks from the section image */
+	for (unsigned long core = 0; core < SCHEDULER_MAX_CORES; ++core) {
+		core_blocks[core] = aligned_alloc(64, (size + 63) & ~63UL);
+		if (!core_blocks[core])
+			abort();
+		memcpy(core_blocks[core], __start_core_data, size);
+	}
+
+	/* The main thread starts out as core 0 */
+	_host_set_core(0);
+}
@@ -0,0 +1,77 @@
+/*
+ * Copyright (C) 2024 Stephen Street
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * scheduler-trace.h
+ *
+ * Layout of the per-core scheduler event trace buffers. The layout is read
+ * from RAM dumps by tools/scheduler-trace.py, keep them in step.
+ */
+
+#ifndef _SCHEDULER_TRACE_H_
+#define _SCHEDULER_TRACE_H_
+
+#include <stdint.h>
+
+#ifndef SCHEDULER_TRACE
+#define SCHEDULER_TRACE 0
+#endif
+
+#ifndef SCHEDULER_TRACE_RECORD_BITS
+#define SCHEDULER_TRACE_RECORD_BITS 9
+#endif
+
+#define SCHEDULER_TRACE_RECORDS (1UL << SCHEDULER_TRACE_RECORD_BITS)
+
+#define SCHEDULER_TRACE_MARKER 0x45435254UL
+#define SCHEDULER_TRACE_VERSION 1
+#define SCHEDULER_TRACE_NO_TASK 0xffff
+
+enum sched_trace_event
+{
+	SCHED_TRACE_SWITCH = 1,
+	SCHED_TRACE_IDLE = 2,
+	SCHED_TRACE_WAIT = 3,
+	SCHED_TRACE_WAKE = 4,
+	SCHED_TRACE_TIMER_EXPIRE = 5,
+	SCHED_TRACE_TICK = 6,
+	SCHED_TRACE_DEFERRED_WAKE = 7,
+};
+
+/*
+ * event              slot          info               arg
+ * SWITCH             next task     next priority      next task address
+ * IDLE               none          0                  0
+ * WAIT               waiting task  1 if blocked       futex address
+ * WAKE               woken task    0                  futex address
+ * TIMER_EXPIRE       expired task  0                  timer expiry tick
+ * TICK               none          0                  tick count
+ * DEFERRED_WAKE      none          1 if wake all      futex address
+ */
+struct sched_trace_record
+{
+	uint32_t timestamp;
+	uint8_t event;
+	uint8_t info;
+	uint16_t slot;
+	uint32_t arg;
+};
+
+struct sched_trace_buffer
+{
+	uint32_t marker;
+	uint16_t version;
+	uint16_t core;
+	uint32_t records;
+	volatile uint32_t head;
+	struct sched_trace_record record[SCHEDULER_TRACE_RECORDS];
+};
+
+#if SCHEDULER_TRACE
+extern struct sched_trace_buffer scheduler_trace_buffers[];
+#endif
+
+#endif
@@ -47,11 +47,13 @@
 #define SCHEDULER_NUM_TASK_PRIORITIES 64UL
 #define SCHEDULER_MAX_TASK_PRIORITY 0UL
 #define SCHEDULER_MIN_TASK_PRIORITY (SCHEDULER_NUM_TASK_PRIORITIES - 1)
+#define SCHEDULER_PRIORITY_MAP_WORDS ((SCHEDULER_NUM_TASK_PRIORITIES + 31) / 32)
 
 #define SCHEDULER_MARKER 0x13700731UL
 #define SCHEDULER_TASK_MARKER 0x137aa731UL
 #define SCHEDULER_FUTEX_MARKER 0x137bb731UL
 #define SCHEDULER_STACK_MARKER 0x137cc731UL
+#define SCHEDULER_TASK_POOL_MARKER 0x137dd731UL
 
 #define SCHEDULER_WAIT_FOREVER 0xffffffffUL
 
@@ -62,15 +64,85 @@
 #define SCHEDULER_PRIMORDIAL_TASK 0x00000010UL
 #define SCHEDULER_CORE_AFFINITY 0x00000020UL
 #define SCHEDULER_CREATE_SUSPENDED 0x00000040UL
+#define SCHEDULER_TASK_EDF 0x00000080UL
 
 #define SCHEDULER_FUTEX_CONTENTION_TRACKING 0x00000001UL
 #define SCHEDULER_FUTEX_PI 0x00000002UL
 #define SCHEDULER_FUTEX_OWNER_TRACKING 0x00000004UL
 
-#ifndef SCHEDULER_MAX_DEFERED_WAKE
-#define SCHEDULER_MAX_DEFERED_WAKE 8
+#ifndef SCHEDULER_MAX_TASKS
+#define SCHEDULER_MAX_TASKS 128
 #endif
 
+#ifndef SCHEDULER_MAX_CORES
+#define SCHEDULER_MAX_CORES 2
+#endif
+
+#ifndef SCHEDULER_BALANCE_TICKS
+#define SCHEDULER_BALANCE_TICKS 16
+#endif
+
+/* Start the tick count this far in, a value just short of a wrap puts the wrap handling through its paces early */
+#ifndef SCHEDULER_INITIAL_TICKS
+#define SCHEDULER_INITIAL_TICKS 0
+#endif
+
+#ifndef SCHEDULER_TIMER_WHEEL_BITS
+#define SCHEDULER_TIMER_WHEEL_BITS 4
+#endif
+
+#if SCHEDULER_TIMER_WHEEL_BITS > 5
+#error "SCHEDULER_TIMER_WHEEL_BITS must be 5 or less"
+#endif
+
+#define SCHEDULER_TIMER_WHEEL_SLOTS (1UL << SCHEDULER_TIMER_WHEEL_BITS)
+#define SCHEDULER_TIMER_WHEEL_LEVELS ((32 + SCHEDULER_TIMER_WHEEL_BITS - 1) / SCHEDULER_TIMER_WHEEL_BITS)
+
+#ifndef SCHEDULER_FUTEX_BUCKET_BITS
+#define SCHEDULER_FUTEX_BUCKET_BITS 5
+#endif
+
+#define SCHEDULER_FUTEX_BUCKETS (1UL << SCHEDULER_FUTEX_BUCKET_BITS)
+
+#ifndef SCHEDULER_STACK_PAINT_WORDS
+#define SCHEDULER_STACK_PAINT_WORDS 16
+#endif
+
+#ifndef SCHEDULER_FUTEX_WAITV_MAX
+#define SCHEDULER_FUTEX_WAITV_MAX 8
+#endif
+
+#ifndef SCHEDULER_PI_MAX_DEPTH
+#define SCHEDULER_PI_MAX_DEPTH 8
+#endif
+
+#ifndef SCHEDULER_MPU_GUARD
+#define SCHEDULER_MPU_GUARD 0
+#endif
+
+#ifndef SCHEDULER_MPU_GUARD_REGION
+#define SCHEDULER_MPU_GUARD_REGION 7
+#endif
+
+/* A power of two from 64 to 256 bytes, it must hold an exception frame plus the largest stack frame expected to overflow */
+#ifndef SCHEDULER_MPU_GUARD_SIZE
+#define SCHEDULER_MPU_GUARD_SIZE 256
+#endif
+
+#ifndef SCHEDULER_TASK_POOL_CLASSES
+#define SCHEDULER_TASK_POOL_CLASSES 4
+#endif
+
+#ifndef SCHEDULER_EDF_PRIORITY
+#define SCHEDULER_EDF_PRIORITY 8UL
+#endif
+
+#ifndef SCHEDULER_EDF_CAPACITY
+#define SCHEDULER_EDF_CAPACITY 100UL
+#endif
+
+#define SCHEDULER_EDF_UTILISATION_SCALE 65536UL
+
 #ifndef SCHEDULER_TIME_SLICE
 #define SCHEDULER_TIME_SLICE INT32_MAX
 #endif
@@ -83,41 +155,46 @@
 #define SCHEDULER_TICK_FREQ 1000UL
 #endif
 
+#ifndef SCHEDULER_TICKLESS
+#define SCHEDULER_TICKLESS 0
+#endif
+
+/* Registers are pointer sized so the host port can run on 64 bit machines */
 struct exception_frame
 {
-	uint32_t r0;
-	uint32_t r1;
-	uint32_t r2;
-	uint32_t r3;
-	uint32_t r12;
-	uint32_t lr;
-	uint32_t pc;
-	uint32_t psr;
+	uintptr_t r0;
+	uintptr_t r1;
+	uintptr_t r2;
+	uintptr_t r3;
+	uintptr_t r12;
+	uintptr_t lr;
+	uintptr_t pc;
+	uintptr_t psr;
 };
 
 struct scheduler_frame
 {
-	uint32_t exec_return;
-	uint32_t control;
-
-	uint32_t r4;
-	uint32_t r5;
-	uint32_t r6;
-	uint32_t r7;
-
-	uint32_t r8;
-	uint32_t r9;
-	uint32_t r10;
-	uint32_t r11;
-
-	uint32_t r0;
-	uint32_t r1;
-	uint32_t r2;
-	uint32_t r3;
-	uint32_t r12;
-	uint32_t lr;
-	uint32_t pc;
-	uint32_t psr;
+	uintptr_t exec_return;
+	uintptr_t control;
+
+	uintptr_t r4;
+	uintptr_t r5;
+	uintptr_t r6;
+	uintptr_t r7;
+
+	uintptr_t r8;
+	uintptr_t r9;
+	uintptr_t r10;
+	uintptr_t r11;
+
+	uintptr_t r0;
+	uintptr_t r1;
+	uintptr_t r2;
+	uintptr_t r3;
+	uintptr_t r12;
+	uintptr_t lr;
+	uintptr_t pc;
+	uintptr_t psr;
 };
 
 struct sched_list
@@ -132,6 +209,27 @@ struct sched_queue
 	struct sched_list tasks;
 };
 
+/* One FIFO per priority, the bitmap tracks the non-empty FIFOs, bit 0 is the highest priority. The migratable map tracks the FIFOs holding unpinned tasks, the lock is a spinlock_t */
+struct sched_ready_queue
+{
+	atomic_ulong lock;
+	unsigned long count;
+	uint32_t priority_map[SCHEDULER_PRIORITY_MAP_WORDS];
+	uint32_t migratable_map[SCHEDULER_PRIORITY_MAP_WORDS];
+	uint16_t migratable[SCHEDULER_NUM_TASK_PRIORITIES];
+	struct sched_queue priorities[SCHEDULER_NUM_TASK_PRIORITIES];
+};
+
+/* Each level covers SCHEDULER_TIMER_WHEEL_BITS of the expiry tick, the bitmaps track the non-empty slots */
+struct sched_timer_wheel
+{
+	uint32_t now;
+	unsigned long armed;
+	uint32_t occupied[SCHEDULER_TIMER_WHEEL_LEVELS];
+	struct sched_list expired;
+	struct sched_list slots[SCHEDULER_TIMER_WHEEL_LEVELS][SCHEDULER_TIMER_WHEEL_SLOTS];
+};
+
 enum task_state
 {
 	TASK_TERMINATED = 1,
@@ -155,6 +253,14 @@ struct task_descriptor
 	unsigned long flags;
 	unsigned long priority;
 	unsigned long affinity;
+
+	/* Round robin quantum in ticks, zero is SCHEDULER_TIME_SLICE */
+	unsigned long quantum;
+
+	/* Only used by SCHEDULER_TASK_EDF tasks, in ticks */
+	unsigned long period;
+	unsigned long deadline;
+	unsigned long budget;
 };
 
 struct task
@@ -163,14 +269,30 @@ struct task
 	struct scheduler_frame *psp;
 	void *tls;
 	unsigned long *stack_marker;
+	unsigned long *stack_low;
+	unsigned long *stack_painted;
 
 	enum task_state state;
+	unsigned long slot;
 	unsigned long core;
 	unsigned long affinity;
 
 	unsigned long base_priority;
 	unsigned long current_priority;
 
+	unsigned long quantum;
+	unsigned long slice_remaining;
+
+	unsigned long long run_time;
+	unsigned long voluntary_switches;
+	unsigned long preempted_switches;
+
+	unsigned long edf_period;
+	unsigned long edf_relative_deadline;
+	unsigned long edf_release;
+	unsigned long edf_deadline;
+	unsigned long edf_utilisation;
+
 	unsigned long timer_expires;
 	struct sched_list timer_node;
 
@@ -178,7 +300,14 @@ struct task
 	struct sched_list owned_futexes;
 
 	struct sched_queue *current_queue;
+	struct sched_ready_queue *ready_queue;
+	bool ready_migratable;
 	struct sched_list queue_node;
+	long *wait_addr;
+	unsigned long wait_flags;
+	struct futex *blocked_on;
+	struct futex_waitv *waitv;
+	unsigned long waitv_count;
 
 	void *context;
 	task_exit_handler_t exit_handler;
@@ -190,23 +319,60 @@ struct task
 struct futex
 {
 	long *value;
-	struct sched_queue waiters;
 	struct sched_list owned;
 	unsigned long flags;
 	unsigned long marker;
 };
 
+/* One address of a vectored wait, the caller fills in the address and the expected value */
+struct futex_waitv
+{
+	long *addr;
+	long value;
+	struct task *task;
+	struct sched_list node;
+};
+
+/* Interrupt wakes are merged into the bucket and the bucket is linked on the deferred wake list, the lock is a spinlock_t */
+struct sched_futex_bucket
+{
+	atomic_ulong lock;
+	atomic_ulong waiters;
+	struct sched_queue queue;
+
+	/* Vectored wait entries hashed into the bucket, the list is protected by the scheduler lock and the count lets wakers skip it */
+	atomic_ulong vectored;
+	struct sched_list waitv;
+
+	atomic_ulong wake_pending;
+	unsigned long wake_next;
+};
+
 struct scheduler
 {
 	size_t tls_size;
 	unsigned long slice_duration;
 
-	struct sched_queue ready_queue;
+	struct sched_ready_queue ready_queue[SCHEDULER_MAX_CORES];
+	unsigned long edf_utilisation[SCHEDULER_MAX_CORES];
+
+	/* Priority of the task running on each core, SCHEDULER_NUM_TASK_PRIORITIES when idle, and the cores with a kick in flight */
+	unsigned long core_priority[SCHEDULER_MAX_CORES];
+	atomic_ulong kicks_pending;
 
 	struct sched_list tasks;
-	struct sched_list timers;
+	unsigned long viable_tasks;
+	struct task *task_table[SCHEDULER_MAX_TASKS];
+	uint16_t task_slots[SCHEDULER_MAX_TASKS];
+	unsigned long free_task_slots;
+
+	struct sched_timer_wheel timers;
 	unsigned long timer_expires;
 
+	/* Waiters are hashed by the address of the futex value, not the futex */
+	struct sched_futex_bucket futex_buckets[SCHEDULER_FUTEX_BUCKETS];
+	atomic_ulong deferred_wakes;
+
 	atomic_int running;
 	atomic_int locked;
 	atomic_uint critical;
@@ -215,6 +381,46 @@ struct scheduler
 	unsigned long marker;
 };
 
+struct task_pool_descriptor
+{
+	size_t block_size;
+	unsigned long count;
+};
+
+/* The blocks of a class are contiguous so a release finds its class by address, free blocks are linked through their first word */
+struct task_pool_class
+{
+	size_t block_size;
+	unsigned long count;
+	unsigned long available;
+	void *blocks;
+	void *free;
+};
+
+/* Size classes are in increasing block size, the lock is a spinlock_t */
+struct task_pool
+{
+	atomic_ulong lock;
+	unsigned long num_classes;
+	struct task_pool_class classes[SCHEDULER_TASK_POOL_CLASSES];
+	unsigned long marker;
+};
+
+/* Times are in microseconds of the hardware timer */
+struct task_stats
+{
+	unsigned long long run_time;
+	unsigned long voluntary_switches;
+	unsigned long preempted_switches;
+};
+
+struct core_stats
+{
+	unsigned long long idle_time;
+	unsigned long switches;
+	unsigned long timestamp;
+};
+
 int scheduler_init(struct scheduler *new_scheduler, size_t tls_size);
 int scheduler_run(void);
 bool scheduler_is_running(void);
@@ -227,6 +433,8 @@ void scheduler_request_switch(unsigned long core);
 void scheduler_tick(void);
 
 unsigned long scheduler_get_ticks(void);
+unsigned long long scheduler_get_ticks64(void);
+unsigned long scheduler_idle_ticks(void);
 
 struct task *scheduler_create(void *stack, size_t stack_size, const struct task_descriptor *descriptor);
 struct task *scheduler_task(void);
@@ -241,6 +449,7 @@ bool scheduler_is_locked(void);
 
 void scheduler_yield(void);
 int scheduler_sleep(unsigned long ticks);
+int scheduler_sleep_until(unsigned long long deadline);
 
 int scheduler_suspend(struct task *task);
 int scheduler_resume(struct task *task);
@@ -248,15 +457,36 @@ int scheduler_terminate(struct task *task);
 
 void scheduler_futex_init(struct futex *futex, long *value, unsigned long flags);
 int scheduler_futex_wait(struct futex *futex, long value, unsigned long ticks);
+int scheduler_futex_wait_until(struct futex *futex, long value, unsigned long long deadline);
 int scheduler_futex_wake(struct futex *futex, bool all);
+int scheduler_futex_wake_n(struct futex *futex, unsigned long count);
+int scheduler_futex_wait_addr(long *addr, long value, unsigned long ticks);
+int scheduler_futex_wait_addr_until(long *addr, long value, unsigned long long deadline);
+int scheduler_futex_wake_addr(long *addr, bool all);
+int scheduler_futex_wake_addr_n(long *addr, unsigned long count);
+int scheduler_futex_requeue(long *addr, long value, struct futex *target);
+int scheduler_futex_waitv(struct futex_waitv *waiters, unsigned long count, unsigned long ticks);
+int scheduler_futex_waitv_until(struct futex_waitv *waiters, unsigned long count, unsigned long long deadline);
+
+int scheduler_edf_wait_period(void);
 
 int scheduler_set_priority(struct task *task, unsigned long priority);
 unsigned long scheduler_get_priority(struct task *task);
+int scheduler_set_quantum(struct task *task, unsigned long quantum);
 
 void scheduler_set_flags(struct task *task, unsigned long mask);
 void scheduler_clear_flags(struct task *task, unsigned long mask);
 unsigned long scheduler_get_flags(struct task *task);
 
 enum task_state scheduler_get_state(struct task *task);
+size_t scheduler_get_stack_space(struct task *task);
+
+int scheduler_get_task_stats(struct task *task, struct task_stats *stats);
+int scheduler_get_core_stats(unsigned long core, struct core_stats *stats);
+
+size_t scheduler_task_pool_size(const struct task_pool_descriptor *classes, unsigned long num_classes);
+int scheduler_task_pool_init(struct task_pool *pool, void *memory, size_t size, const struct task_pool_descriptor *classes, unsigned long num_classes);
+void *scheduler_task_pool_alloc(struct task_pool *pool, size_t size);
+void scheduler_task_pool_release(struct task_pool *pool, void *block);
 
 #endif
@@ -20,13 +20,17 @@
 
 #include <hardware/platform_defs.h>
 #include <hardware/exception.h>
+#include <hardware/irq.h>
 #include <hardware/address_mapped.h>
 #include <hardware/regs/sio.h>
+#include <hardware/structs/timer.h>
+#include <hardware/timer.h>
 
 #include <pico/toolkit/cmsis.h>
 #include <pico/toolkit/scheduler.h>
 #include <pico/toolkit/tls.h>
 #include <pico/toolkit/retarget-lock.h>
+#include <pico/toolkit/fault.h>
 
 
 #define LIBC_LOCK_MARKER 0x89988998
@@ -34,7 +38,6 @@
 struct __rtos_runtime_lock
 {
 	struct __retarget_runtime_lock retarget_lock;
-	struct futex futex;
 };
 
 extern void _set_tls(void *tls);
@@ -51,12 +54,20 @@ void scheduler_spin_lock(void);
 void scheduler_spin_unlock(void);
 unsigned int scheduler_spin_lock_irqsave(void);
 void scheduler_spin_unlock_irqrestore(unsigned int state);
+void scheduler_tickless_hook(unsigned long delay);
 
 extern __weak void multicore_startup_hook(void);
 extern __weak void multicore_shutdown_hook(void);
 
 static core_local void *old_tls = { 0 };
 
+#if SCHEDULER_TICKLESS
+#define SCHEDULER_TICK_US (1000000UL / SCHEDULER_TICK_FREQ)
+#define SCHEDULER_MAX_ALARM_DELAY (INT32_MAX / SCHEDULER_TICK_US)
+
+static core_local int tick_alarm = -1;
+#endif
+
 static struct __rtos_runtime_lock libc_recursive_mutex = { 0 };
 struct __lock __lock___libc_recursive_mutex =
 {
@@ -91,7 +102,6 @@ void __retarget_runtime_lock_init_once(struct __lock *lock)
 	/* Initialize the lock */
 	rtos_runtime_lock->retarget_lock.value = 0;
 	rtos_runtime_lock->retarget_lock.count = 0;
-	scheduler_futex_init(&rtos_runtime_lock->futex, &rtos_runtime_lock->retarget_lock.value, 0);
 
 	/*  Mark as done */
 	atomic_store(&rtos_runtime_lock->retarget_lock.marker, LIBC_LOCK_MARKER);
@@ -129,7 +139,7 @@ void __retarget_runtime_relax(_LOCK_T lock)
 	struct __rtos_runtime_lock *rtos_runtime_lock = lock->retarget_lock;
 
 	if ((__retarget_runtime_lock_value() & 0xfffffffc) != 0) {
-		int status = scheduler_futex_wait(&rtos_runtime_lock->futex, rtos_runtime_lock->retarget_lock.expected, SCHEDULER_WAIT_FOREVER);
+		int status = scheduler_futex_wait_addr(&rtos_runtime_lock->retarget_lock.value, rtos_runtime_lock->retarget_lock.expected, SCHEDULER_WAIT_FOREVER);
 		if (status < 0)
 			abort();
 		return;
@@ -150,7 +160,7 @@ void __retarget_runtime_wake(_LOCK_T lock)
 	}
 
 	/* Let the waiters contend for the lock */
-	int status = scheduler_futex_wake(&rtos_runtime_lock->futex, false);
+	int status = scheduler_futex_wake_addr(&rtos_runtime_lock->retarget_lock.value, false);
 	if (status < 0)
 		abort();
 }
@@ -165,6 +175,65 @@ void scheduler_switch_hook(struct task *task)
 	_set_tls(task != 0 ? task->tls : 0);
 }
 
+#if SCHEDULER_MPU_GUARD
+void identify_fault(struct cortexm_fault *fault)
+{
+	/* Only faults taken on the process stack belong to a task */
+	struct task *task = scheduler_task();
+	if (!task || fault->exception_return != 0xfffffffd)
+		return;
+
+	/* A task frame at or below the guard means the task ran off the end of its stack */
+	fault->task = (uint32_t)task;
+	fault->stack_overflow = (task->flags & SCHEDULER_TASK_STACK_CHECK) && fault->SP < (uint32_t)task->stack_marker + SCHEDULER_MPU_GUARD_SIZE;
+}
+#endif
+
+#if SCHEDULER_TICKLESS
+unsigned long scheduler_get_ticks(void)
+{
+	/* The free running 64-bit timer is shared by both cores, so this is monotonic everywhere */
+	return time_us_64() / SCHEDULER_TICK_US + (uint32_t)SCHEDULER_INITIAL_TICKS;
+}
+
+unsigned long long scheduler_get_ticks64(void)
+{
+	/* The timer is already 64 bits wide, no need for the software extension */
+	return time_us_64() / SCHEDULER_TICK_US + (uint32_t)SCHEDULER_INITIAL_TICKS;
+}
+
+static void scheduler_alarm_handler(void)
+{
+	/* Acknowledge the alarm of this core */
+	timer_hw->intr = 1UL << cls_datum(tick_alarm);
+
+	/* Forward the to the scheduler tick handler */
+	scheduler_tick();
+}
+
+void scheduler_tickless_hook(unsigned long delay)
+{
+	int alarm = cls_datum(tick_alarm);
+
+	/* Nothing due, sleep until some other interrupt has work for us */
+	if (delay == SCHEDULER_WAIT_FOREVER) {
+		timer_hw->armed = 1UL << alarm;
+		return;
+	}
+
+	/* The alarm only matches the low 32 bits of the timer, an early wake up just re-arms */
+	if (delay > SCHEDULER_MAX_ALARM_DELAY)
+		delay = SCHEDULER_MAX_ALARM_DELAY;
+
+	/* Wake up on a tick boundary */
+	uint64_t target = (time_us_64() / SCHEDULER_TICK_US + delay) * SCHEDULER_TICK_US;
+	timer_hw->alarm[alarm] = (uint32_t)target;
+
+	/* Missed it, fire by hand */
+	if (time_us_64() >= target)
+		NVIC_SetPendingIRQ(TIMER_IRQ_0 + alarm);
+}
+#else
 static void SysTick_Handler(void)
 {
 	/* Clear the Overflow */
@@ -173,6 +242,7 @@ static void SysTick_Handler(void)
 	/* Forward the to the scheduler tick handler */
 	scheduler_tick();
 }
+#endif
 
 void scheduler_startup_hook(void)
 {
@@ -184,16 +254,26 @@ void scheduler_startup_hook(void)
 	/* Disable deep sleep wake and generate a SEV on pending interrupts*/
 	SCB->SCR = SCB_SCR_SEVONPEND_Msk;
 
-	/* We need to install a systick handler */
-	exception_set_exclusive_handler(SYSTICK_EXCEPTION, SysTick_Handler);
-
 	/* Save the initial tls pointer */
 	cls_datum(old_tls) = __aeabi_read_tp();
 
+#if SCHEDULER_TICKLESS
+	/* Each core gets its own timer alarm, the interrupt is only enabled in the NVIC of this core */
+	int alarm = hardware_alarm_claim_unused(true);
+	cls_datum(tick_alarm) = alarm;
+	irq_set_exclusive_handler(TIMER_IRQ_0 + alarm, scheduler_alarm_handler);
+	hw_set_bits(&timer_hw->inte, 1UL << alarm);
+	NVIC_SetPriority(TIMER_IRQ_0 + alarm, SCHEDULER_SYSTICK_PRIORITY);
+	NVIC_EnableIRQ(TIMER_IRQ_0 + alarm);
+#else
+	/* We need to install a systick handler */
+	exception_set_exclusive_handler(SYSTICK_EXCEPTION, SysTick_Handler);
+
 	/* Initialize the system tick at 1ms for this core */
 	SysTick->LOAD  = (SystemCoreClock / 1000) - 1UL;
 	SysTick->VAL   = 0UL;
 	SysTick->CTRL  = SysTick_CTRL_CLKSOURCE_Msk | SysTick_CTRL_TICKINT_Msk | SysTick_CTRL_ENABLE_Msk;
+#endif
 
 	/* Optionally pass to the multicore hook */
 	multicore_startup_hook();
@@ -201,8 +281,18 @@ void scheduler_startup_hook(void)
 
 void scheduler_shutdown_hook(void)
 {
+#if SCHEDULER_TICKLESS
+	/* Release the alarm of this core */
+	int alarm = cls_datum(tick_alarm);
+	NVIC_DisableIRQ(TIMER_IRQ_0 + alarm);
+	hw_clear_bits(&timer_hw->inte, 1UL << alarm);
+	timer_hw->armed = 1UL << alarm;
+	hardware_alarm_unclaim(alarm);
+	cls_datum(tick_alarm) = -1;
+#else
 	/* Disable the systick */
 	SysTick->CTRL = 0;
+#endif
 
 	/* Restore the initial tls pointer */
 	_set_tls(cls_datum(old_tls));
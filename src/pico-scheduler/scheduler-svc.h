@@ -0,0 +1,29 @@
+/*
+ * Copyright (C) 2024 Stephen Street
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * scheduler-svc.h
+ */
+
+#ifndef _SCHEDULER_SVC_H_
+#define _SCHEDULER_SVC_H_
+
+/* Shared with the assembler, which aliases an SVC handler for every service */
+#define SCHEDULER_START_SVC 0
+#define SCHEDULER_CREATE_SVC 1
+#define SCHEDULER_YIELD_SVC 2
+#define SCHEDULER_TERMINATE_SVC 3
+#define SCHEDULER_SUSPEND_SVC 4
+#define SCHEDULER_RESUME_SVC 5
+#define SCHEDULER_WAIT_SVC 6
+#define SCHEDULER_WAKE_SVC 7
+#define SCHEDULER_PRIORITY_SVC 8
+#define SCHEDULER_REQUEUE_SVC 9
+#define SCHEDULER_WAITV_SVC 10
+
+#define SCHEDULER_NUM_SVCS 11
+
+#endif
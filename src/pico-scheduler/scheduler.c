@@ -21,22 +21,21 @@
 #include <pico/toolkit/tls.h>
 
 #include <pico/toolkit/cmsis.h>
+#include <pico/toolkit/spinlock.h>
 #include <pico/toolkit/scheduler.h>
+#include <pico/toolkit/scheduler-trace.h>
 
-#include "svc.h"
+#include <hardware/structs/timer.h>
 
-#define SCHEDULER_START_SVC 0
-#define SCHEDULER_CREATE_SVC 1
-#define SCHEDULER_YIELD_SVC 2
-#define SCHEDULER_TERMINATE_SVC 3
-#define SCHEDULER_SUSPEND_SVC 4
-#define SCHEDULER_RESUME_SVC 5
-#define SCHEDULER_WAIT_SVC 6
-#define SCHEDULER_WAKE_SVC 7
-#define SCHEDULER_PRIORITY_SVC 8
+#include "svc.h"
+#include "scheduler-svc.h"
 
 #define SCHEDULER_FRAME_NEEDED 0x00000002
 
+#define SCHEDULER_WAKE_ALL 0x00000001
+#define SCHEDULER_WAKE_BUCKET 0x00000002
+#define SCHEDULER_WAKE_MASK (SCHEDULER_WAKE_ALL | SCHEDULER_WAKE_BUCKET)
+
 #define ALIGNMENT_ROUND_SIZE(SIZE, BYTES) ((SIZE + (BYTES - 1)) & ~(BYTES - 1))
 #define ALIGNMENT_ROUND_TYPE(TYPE, BYTES) ((sizeof(TYPE) + (BYTES - 1)) & ~(BYTES - 1))
 #define DELAY_MAX (UINT32_MAX / 2)
@@ -62,8 +61,10 @@ void scheduler_resume_svc(struct exception_frame *frame);
 void scheduler_wait_svc(struct scheduler_frame *frame);
 void scheduler_wake_svc(struct exception_frame *frame);
 void scheduler_priority_svc(struct exception_frame *frame);
+void scheduler_requeue_svc(struct exception_frame *frame);
+void scheduler_waitv_svc(struct scheduler_frame *frame);
 
-struct scheduler_frame *scheduler_switch(struct scheduler_frame *frame);
+struct scheduler_frame *scheduler_switch(struct scheduler_frame *frame, void *cls);
 
 extern __weak void scheduler_idle_hook(void);
 extern __weak void scheduler_switch_hook(struct task *task);
@@ -72,34 +73,56 @@ extern __weak void scheduler_tick_hook(unsigned long ticks);
 extern __weak void scheduler_tls_init_hook(void *tls);
 extern __weak void scheduler_startup_hook(void);
 extern __weak void scheduler_shutdown_hook(void);
+extern __weak void scheduler_tickless_hook(unsigned long delay);
 
 extern __weak void scheduler_spin_lock(void);
 extern __weak void scheduler_spin_unlock(void);
+extern __weak unsigned int scheduler_spin_lock_irqsave(void);
+extern __weak void scheduler_spin_unlock_irqrestore(unsigned int state);
 
 extern __weak void enable_debugger_support(void);
 
-uint32_t scheduler_svc_vector[] =
-{
-	(uint32_t) 0,
-	(uint32_t) scheduler_create_svc,
-	(uint32_t) scheduler_yield_svc,
-	(uint32_t) scheduler_terminate_svc,
-	(uint32_t) scheduler_suspend_svc,
-	(uint32_t) scheduler_resume_svc,
-	(uint32_t) scheduler_wait_svc,
-	(uint32_t) scheduler_wake_svc,
-	(uint32_t) scheduler_priority_svc,
+uintptr_t scheduler_svc_vector[] =
+{
+	(uintptr_t) 0,
+	(uintptr_t) scheduler_create_svc,
+	(uintptr_t) scheduler_yield_svc,
+	(uintptr_t) scheduler_terminate_svc,
+	(uintptr_t) scheduler_suspend_svc,
+	(uintptr_t) scheduler_resume_svc,
+	(uintptr_t) scheduler_wait_svc,
+	(uintptr_t) scheduler_wake_svc,
+	(uintptr_t) scheduler_priority_svc,
+	(uintptr_t) scheduler_requeue_svc,
+	(uintptr_t) scheduler_waitv_svc,
 };
 
+/* Every service needs an SVC handler alias in scheduler-m0plus-asm.S, which checks the same count */
+_Static_assert(sizeof(scheduler_svc_vector) / sizeof(scheduler_svc_vector[0]) == SCHEDULER_NUM_SVCS, "scheduler_svc_vector does not match SCHEDULER_NUM_SVCS");
+
+#if SCHEDULER_MPU_GUARD
+_Static_assert(SCHEDULER_MPU_GUARD_SIZE >= 64 && SCHEDULER_MPU_GUARD_SIZE <= 256 && (SCHEDULER_MPU_GUARD_SIZE & (SCHEDULER_MPU_GUARD_SIZE - 1)) == 0, "SCHEDULER_MPU_GUARD_SIZE must be 64, 128 or 256");
+#endif
+
 struct scheduler *scheduler = 0;
 
 core_local struct scheduler_frame *scheduler_initial_frame = 0;
 core_local struct task *current_task = 0;
-core_local int slice_expires = INT32_MAX;
+core_local unsigned long slice_expires = 0;
 core_local unsigned long ticks = 0;
-core_local atomic_ulong deferred_wake[SCHEDULER_MAX_DEFERED_WAKE];
-core_local atomic_ulong taken_wake_counter = 0;
-core_local atomic_ulong given_wake_counter = 0;
+core_local unsigned long switch_timestamp = 0;
+core_local unsigned long switch_count = 0;
+core_local bool yield_pending = false;
+core_local unsigned long long idle_time = 0;
+core_local unsigned long idle_start = 0;
+core_local bool idle_active = false;
+
+static atomic_ulong ticks_epoch = 0;
+static atomic_ulong ticks_sequence = 0;
+
+#if SCHEDULER_TRACE
+struct sched_trace_buffer scheduler_trace_buffers[SCHEDULER_MAX_CORES];
+#endif
 
 static inline void sched_list_init(struct sched_list *list)
 {
@@ -230,18 +253,56 @@ static inline struct task *sched_get_current(void)
 	return task;
 }
 
-static inline struct task *sched_set_current(struct task *task)
+static inline __always_inline unsigned long sched_timestamp(void)
+{
+	/* Low word of the 1us system timer, differences are good for about 71 minutes */
+	return timer_hw->timerawl;
+}
+
+static inline __always_inline struct task *sched_exchange_current(void *cls, unsigned long core, struct task *task)
 {
 	assert(task == 0 || task->marker == SCHEDULER_TASK_MARKER);
 
-	struct task *prev = cls_datum(current_task);
-	cls_datum(current_task) = task;
+	struct task *prev = cls_datum_at(cls, current_task);
+	cls_datum_at(cls, current_task) = task;
+	scheduler->core_priority[core] = task ? task->current_priority : SCHEDULER_NUM_TASK_PRIORITIES;
 
-	scheduler_switch_hook(task);
+	/* Charge the time since the current task last changed to the outgoing task */
+	unsigned long now = sched_timestamp();
+	if (prev)
+		prev->run_time += now - cls_datum_at(cls, switch_timestamp);
+	cls_datum_at(cls, switch_timestamp) = now;
 
 	return prev;
 }
 
+/* The switch hook runs from scheduler_switch once the next task is known */
+static inline struct task *sched_set_current(struct task *task)
+{
+	return sched_exchange_current(cls_ptr(), scheduler_current_core(), task);
+}
+
+#if SCHEDULER_TRACE
+static inline __always_inline void sched_trace(enum sched_trace_event event, const struct task *task, unsigned long info, uint32_t arg)
+{
+	/* Only this core writes its buffer, masking interrupts is enough to claim a record */
+	struct sched_trace_buffer *buffer = &scheduler_trace_buffers[scheduler_current_core()];
+	uint32_t state = disable_interrupts();
+	uint32_t head = buffer->head++;
+	enable_interrupts(state);
+
+	/* Fill in the claimed record, the timestamp is the low word of the 1us system timer */
+	struct sched_trace_record *record = &buffer->record[head & (SCHEDULER_TRACE_RECORDS - 1)];
+	record->timestamp = sched_timestamp();
+	record->event = event;
+	record->info = info;
+	record->slot = task ? task->slot : SCHEDULER_TRACE_NO_TASK;
+	record->arg = arg;
+}
+#else
+#define sched_trace(event, task, info, arg) do { } while (0)
+#endif
+
 static inline void sched_queue_init(struct sched_queue *queue)
 {
 	assert(queue != 0);
@@ -259,6 +320,24 @@ static inline void sched_queue_remove(struct task *task)
 	assert(task != 0);
 
 	sched_list_remove(&task->queue_node);
+
+	/* Leaving a ready queue FIFO empty must clear the priority bit, likewise for the last unpinned task */
+	struct sched_ready_queue *ready_queue = task->ready_queue;
+	if (ready_queue) {
+		unsigned long priority = task->current_queue - ready_queue->priorities;
+		--ready_queue->count;
+		if (sched_queue_empty(task->current_queue))
+			ready_queue->priority_map[priority / 32] &= ~(1UL << (priority % 32));
+		if (task->ready_migratable && --ready_queue->migratable[priority] == 0)
+			ready_queue->migratable_map[priority / 32] &= ~(1UL << (priority % 32));
+
+	/* Leaving a futex bucket drops its waiter count and the address, nothing may lock the bucket for the task afterwards */
+	} else if (task->current_queue && task->wait_addr) {
+		atomic_fetch_sub(&sched_container_of(task->current_queue, struct sched_futex_bucket, queue)->waiters, 1);
+		task->wait_addr = 0;
+	}
+
+	task->ready_queue = 0;
 	task->current_queue = 0;
 }
 
@@ -284,53 +363,453 @@ static void sched_queue_push(struct sched_queue *queue, struct task *task)
 	task->current_queue = queue;
 }
 
-static struct task *sched_queue_pop(struct sched_queue *queue, unsigned long core)
+static const uint8_t sched_debruijn_position[32] =
 {
-	struct task *task;
+	0, 1, 28, 2, 29, 14, 24, 3, 30, 22, 20, 15, 25, 17, 4, 8,
+	31, 27, 13, 23, 21, 19, 16, 7, 26, 12, 18, 6, 11, 5, 10, 9,
+};
+
+static inline __always_inline unsigned long sched_find_first_set(uint32_t word)
+{
+	/* No CLZ on the M0+, isolate the lowest set bit and hash it with a de Bruijn sequence */
+	assert(word != 0);
+	return sched_debruijn_position[(uint32_t)((word & -word) * 0x077cb531U) >> 27];
+}
+
+static inline bool sched_edf_urgent(const struct task *task)
+{
+	/* Tasks boosted into the band are running a critical section some EDF task is waiting for */
+	return (task->flags & SCHEDULER_TASK_EDF) == 0 || !sched_list_empty((struct sched_list *)&task->owned_futexes);
+}
+
+static inline bool sched_edf_before(const struct task *task, const struct task *other)
+{
+	/* Urgent tasks go first, then the earliest absolute deadline, ties stay FIFO */
+	bool urgent = sched_edf_urgent(task);
+	if (urgent || sched_edf_urgent(other))
+		return urgent && !sched_edf_urgent(other);
+
+	return (int32_t)(task->edf_deadline - other->edf_deadline) < 0;
+}
+
+static void sched_edf_insert(struct sched_list *fifo, struct task *task)
+{
+	/* Usually the tail, otherwise a short walk to the first task with a later deadline */
+	if (!sched_list_empty(fifo) && sched_edf_before(task, sched_list_last_entry(fifo, struct task, queue_node))) {
+		struct task *entry;
+		sched_list_for_each_entry(entry, fifo, queue_node)
+			if (sched_edf_before(task, entry)) {
+				sched_list_insert_before(&entry->queue_node, &task->queue_node);
+				return;
+			}
+	}
+
+	sched_list_push(fifo, &task->queue_node);
+}
 
+static inline bool sched_ready_preempts(const struct task *task, const struct task *running)
+{
+	/* Higher priority wins, inside the EDF band the earlier deadline does */
+	if (!running)
+		return true;
+
+	if (task->current_priority != running->current_priority)
+		return task->current_priority < running->current_priority;
+
+	return task->current_priority == SCHEDULER_EDF_PRIORITY && sched_edf_before(task, running);
+}
+
+static inline void sched_ready_queue_init(struct sched_ready_queue *queue)
+{
 	assert(queue != 0);
 
-	/* Just take the first task */
-	if (core == UINT32_MAX) {
-		task = sched_list_pop_entry(&queue->tasks, struct task, queue_node);
-		if (task)
-			task->current_queue = 0;
-		return task;
+	queue->lock = 0;
+	queue->count = 0;
+	for (unsigned long i = 0; i < SCHEDULER_PRIORITY_MAP_WORDS; ++i) {
+		queue->priority_map[i] = 0;
+		queue->migratable_map[i] = 0;
 	}
 
-	/* Look for the highest priority task which can run on this core */
-	sched_list_for_each_entry(task, &queue->tasks, queue_node) {
-		if ((task->flags & SCHEDULER_CORE_AFFINITY) == 0 || task->affinity == core) {
-			sched_queue_remove(task);
+	for (unsigned long i = 0; i < SCHEDULER_NUM_TASK_PRIORITIES; ++i) {
+		queue->migratable[i] = 0;
+		sched_queue_init(&queue->priorities[i]);
+	}
+}
+
+static inline unsigned long sched_ready_map_highest_priority(const uint32_t *map)
+{
+	for (unsigned long i = 0; i < SCHEDULER_PRIORITY_MAP_WORDS; ++i)
+		if (map[i] != 0)
+			return i * 32 + sched_find_first_set(map[i]);
+
+	return SCHEDULER_NUM_TASK_PRIORITIES;
+}
+
+static inline unsigned long sched_ready_queue_highest_priority(struct sched_ready_queue *queue)
+{
+	assert(queue != 0);
+
+	return sched_ready_map_highest_priority(queue->priority_map);
+}
+
+static inline void sched_ready_queue_push(struct sched_ready_queue *queue, struct task *task)
+{
+	assert(queue != 0 && task != 0 && task->current_queue == 0 && task->current_priority < SCHEDULER_NUM_TASK_PRIORITIES);
+
+	/* The tail of the priority FIFO, the head if preempted inside its quantum, the EDF band is kept in deadline order */
+	unsigned long priority = task->current_priority;
+	if (priority == SCHEDULER_EDF_PRIORITY)
+		sched_edf_insert(&queue->priorities[priority].tasks, task);
+	else if (task->slice_remaining != 0)
+		sched_list_insert_after(&queue->priorities[priority].tasks, &task->queue_node);
+	else
+		sched_list_push(&queue->priorities[priority].tasks, &task->queue_node);
+	queue->priority_map[priority / 32] |= 1UL << (priority % 32);
+	++queue->count;
+
+	/* Remember if other cores may steal it, the affinity could change while queued */
+	task->ready_migratable = (task->flags & SCHEDULER_CORE_AFFINITY) == 0;
+	if (task->ready_migratable && queue->migratable[priority]++ == 0)
+		queue->migratable_map[priority / 32] |= 1UL << (priority % 32);
+
+	task->current_queue = &queue->priorities[priority];
+	task->ready_queue = queue;
+}
+
+static inline struct task *sched_ready_queue_peek(struct sched_ready_queue *queue)
+{
+	assert(queue != 0);
+
+	/* Everything on a core queue can run on that core, so this is just the head of the highest FIFO */
+	unsigned long priority = sched_ready_queue_highest_priority(queue);
+	if (priority == SCHEDULER_NUM_TASK_PRIORITIES)
+		return 0;
+
+	return sched_list_first_entry(&queue->priorities[priority].tasks, struct task, queue_node);
+}
+
+static struct task *sched_ready_queue_peek_migratable(struct sched_ready_queue *queue)
+{
+	struct task *task;
+
+	assert(queue != 0);
+
+	/* Only the highest priority holding an unpinned task is visited, pinned tasks ahead of it are skipped */
+	unsigned long priority = sched_ready_map_highest_priority(queue->migratable_map);
+	if (priority == SCHEDULER_NUM_TASK_PRIORITIES)
+		return 0;
+
+	sched_list_for_each_entry(task, &queue->priorities[priority].tasks, queue_node)
+		if (task->ready_migratable)
 			return task;
+
+	assert(false);
+	return 0;
+}
+
+static unsigned long sched_ready_best_priority(unsigned long core)
+{
+	/* Anything on the core queue, or the unpinned tasks on the others */
+	unsigned long best = sched_ready_queue_highest_priority(&scheduler->ready_queue[core]);
+	for (unsigned long other = 0; other < scheduler_num_cores(); ++other) {
+		if (other != core) {
+			unsigned long priority = sched_ready_map_highest_priority(scheduler->ready_queue[other].migratable_map);
+			if (priority < best)
+				best = priority;
+		}
+	}
+
+	return best;
+}
+
+static unsigned long sched_ready_select_core(struct task *task, unsigned long current_core)
+{
+	/* Pinned tasks only ever live on the queue of their core */
+	if (task->flags & SCHEDULER_CORE_AFFINITY)
+		return task->affinity;
+
+	/* Push to an idle core or the core running the lowest priority task, the current core wins ties */
+	unsigned long selected = current_core;
+	unsigned long selected_priority = 0;
+	for (unsigned long core = 0; core < scheduler_num_cores(); ++core) {
+		unsigned long core_priority = cls_datum_core(core, current_task) != task ? scheduler->core_priority[core] : SCHEDULER_NUM_TASK_PRIORITIES;
+		if (core_priority > selected_priority || (core_priority == selected_priority && core == current_core)) {
+			selected = core;
+			selected_priority = core_priority;
 		}
 	}
 
+	return selected;
+}
+
+static inline void sched_ready_lock_all(void)
+{
+	/* Always in core order, a switch holding its own queue drops it before taking them all */
+	for (unsigned long core = 0; core < scheduler_num_cores(); ++core)
+		spin_lock(&scheduler->ready_queue[core].lock);
+}
+
+static inline void sched_ready_unlock_all(void)
+{
+	for (unsigned long core = 0; core < scheduler_num_cores(); ++core)
+		spin_unlock(&scheduler->ready_queue[core].lock);
+}
+
+static struct sched_ready_queue *sched_ready_lock_task(struct task *task)
+{
+	/* Queued tasks belong to their queue and running tasks to the queue of their core, a switch moves them holding both */
+	while (task->state == TASK_READY || task->state == TASK_RUNNING) {
+
+		/* Caught between queues by a switch, look again */
+		struct sched_ready_queue *queue = task->ready_queue;
+		if (!queue && task->state == TASK_RUNNING && task->core < SCHEDULER_MAX_CORES)
+			queue = &scheduler->ready_queue[task->core];
+		if (!queue) {
+			atomic_thread_fence(memory_order_acquire);
+			continue;
+		}
+
+		/* Still the owner once locked? */
+		spin_lock(&queue->lock);
+		if (task->ready_queue == queue || (!task->ready_queue && task->state == TASK_RUNNING && queue == &scheduler->ready_queue[task->core]))
+			return queue;
+		spin_unlock(&queue->lock);
+	}
+
+	/* Blocked, suspended and terminated tasks only change under the scheduler lock */
 	return 0;
 }
 
-static inline unsigned long sched_queue_highest_priority(struct sched_queue *queue)
+static bool sched_ready_steal_wanted(unsigned long core)
 {
-	unsigned long highest = SCHEDULER_NUM_TASK_PRIORITIES;
+	struct sched_ready_queue *local = &scheduler->ready_queue[core];
+	unsigned long local_priority = sched_ready_queue_highest_priority(local);
 
-	assert(queue != 0);
+	/* Lockless peek at the other queues with the same tests as sched_ready_best, which decides once every queue is locked */
+	for (unsigned long other = 0; other < scheduler_num_cores(); ++other) {
+		struct sched_ready_queue *remote = &scheduler->ready_queue[other];
+		if (other == core)
+			continue;
+
+		unsigned long priority = sched_ready_map_highest_priority(remote->migratable_map);
+		if (priority == SCHEDULER_NUM_TASK_PRIORITIES)
+			continue;
 
-	if (!sched_queue_empty(queue))
-		highest = sched_list_first_entry(&queue->tasks, struct task, queue_node)->current_priority;
+		if (priority < local_priority || (priority == local_priority && (priority == SCHEDULER_EDF_PRIORITY || remote->count > local->count + 1)))
+			return true;
+	}
 
-	return highest;
+	return false;
+}
+
+static struct task *sched_ready_best(unsigned long core)
+{
+	struct sched_ready_queue *local = &scheduler->ready_queue[core];
+	struct task *task = sched_ready_queue_peek(local);
+
+	/* Pull a higher priority task from another core, equal priorities only when the other core is overloaded */
+	for (unsigned long other = 0; other < scheduler_num_cores(); ++other) {
+
+		/* Skip ourselves and empty queues */
+		struct sched_ready_queue *remote = &scheduler->ready_queue[other];
+		if (other == core || remote->count == 0)
+			continue;
+
+		/* Anything we can steal? */
+		struct task *candidate = sched_ready_queue_peek_migratable(remote);
+		if (!candidate)
+			continue;
+
+		/* Better than what we have? */
+		if (!task || sched_ready_preempts(candidate, task) || (candidate->current_priority == task->current_priority && remote->count > local->count + 1))
+			task = candidate;
+	}
+
+	return task;
+}
+
+static bool sched_ready_kick_edf(unsigned long core)
+{
+	/* Ties at the EDF priority are decided by deadline, which needs the queued and the running task to hold still */
+	sched_ready_lock_all();
+	struct task *best = sched_ready_best(core);
+	bool kick = best != 0 && sched_ready_preempts(best, cls_datum_core(core, current_task));
+	sched_ready_unlock_all();
+
+	return kick;
+}
+
+static void sched_ready_kick(unsigned long core)
+{
+	/* Our pushes must be visible before reading the priorities of the other cores, which publish theirs before peeking */
+	atomic_thread_fence(memory_order_seq_cst);
+
+	/* Kick other cores, including idle ones, which now have a better task to run from their queue or by stealing */
+	for (unsigned long other = 0; other < scheduler_num_cores(); ++other) {
+
+		/* Other cores without a kick already in flight */
+		if (other == core || (atomic_load(&scheduler->kicks_pending) & (1UL << other)))
+			continue;
+
+		/* Only kick the other core if there is a higher priority task to run, only an EDF tie needs the tasks */
+		unsigned long best = sched_ready_best_priority(other);
+		unsigned long running = scheduler->core_priority[other];
+		if (best > running || (best == running && (best != SCHEDULER_EDF_PRIORITY || !sched_ready_kick_edf(other))))
+			continue;
+
+		if ((atomic_fetch_or(&scheduler->kicks_pending, 1UL << other) & (1UL << other)) == 0)
+			scheduler_request_switch(other);
+	}
+}
+
+static void sched_ready_push(struct task *task)
+{
+	unsigned long core = scheduler_current_core();
+	unsigned long target = sched_ready_select_core(task, core);
+	struct sched_ready_queue *queue = &scheduler->ready_queue[target];
+
+	spin_lock(&queue->lock);
+	sched_ready_queue_push(queue, task);
+	spin_unlock(&queue->lock);
+
+	/* Only our own switch would notice a task left for another core, which may have no tick coming to look */
+	if (target != core)
+		sched_ready_kick(core);
+}
+
+static inline bool sched_ready_imbalanced(unsigned long core)
+{
+	/* Lockless peek at the queue lengths, a stale answer only costs or delays a balancing switch */
+	unsigned long local = scheduler->ready_queue[core].count;
+	for (unsigned long other = 0; other < scheduler_num_cores(); ++other)
+		if (other != core && scheduler->ready_queue[other].count > local + 1)
+			return true;
+
+	return false;
 }
 
 static void sched_queue_reprioritize(struct task *task, unsigned long new_priority)
 {
 	assert(task != 0);
 
+	/* Futex buckets are searched by priority on wake, only the run queues and the running priority of the core need updating */
+	struct sched_ready_queue *owner = sched_ready_lock_task(task);
 	task->current_priority = new_priority;
-	struct sched_queue *queue = task->current_queue;
-	if (queue) {
+	if (task->state == TASK_RUNNING && task->core < SCHEDULER_MAX_CORES)
+		scheduler->core_priority[task->core] = new_priority;
+	struct sched_ready_queue *ready_queue = task->ready_queue;
+	if (ready_queue) {
 		sched_queue_remove(task);
-		sched_queue_push(queue, task);
+		sched_ready_queue_push(ready_queue, task);
+	}
+	if (owner)
+		spin_unlock(&owner->lock);
+
+	/* A task queued or running on another core may change what that core should run */
+	unsigned long core = scheduler_current_core();
+	if (owner && owner != &scheduler->ready_queue[core])
+		sched_ready_kick(core);
+}
+
+/*
+ * Lock ordering:
+ *
+ * 1. Futex bucket lock, protects the bucket wait queue and the futex value check
+ * 2. Scheduler lock, protects the timer wheel, task states and priorities
+ * 3. Ready queue locks, protect each core queue and the ready and running tasks it owns
+ *
+ * A bucket lock is always taken before the scheduler lock. Only requeue holds two bucket locks, which
+ * it takes in bucket order.
+ * Bucket wait queues are only modified holding both locks, so either lock is enough to search them.
+ * Code already holding the scheduler lock may only try a bucket lock, on failure it must back off
+ * or retry later. Interrupt handlers take none of the locks.
+ * A switch moves tasks between ready and running holding only the ready queue locks, in core order
+ * when it needs more than its own. Everything else changing a ready or running task holds the
+ * scheduler lock and the lock of the queue owning the task.
+ */
+static inline struct sched_futex_bucket *sched_futex_bucket(const long *addr)
+{
+	/* Fibonacci hash of the word address */
+	return &scheduler->futex_buckets[((uint32_t)((uintptr_t)addr >> 2) * 0x9e3779b1U) >> (32 - SCHEDULER_FUTEX_BUCKET_BITS)];
+}
+
+static struct task *sched_futex_best_waiter(const long *addr)
+{
+	/* Waiters can be re-prioritized while queued, so check them all, the earliest waiter wins ties */
+	struct task *best = 0;
+	struct task *task;
+	sched_list_for_each_entry(task, &sched_futex_bucket(addr)->queue.tasks, queue_node)
+		if (task->wait_addr == addr && (!best || task->current_priority < best->current_priority))
+			best = task;
+
+	return best;
+}
+
+static inline unsigned long sched_futex_highest_priority(const long *addr)
+{
+	struct task *task = sched_futex_best_waiter(addr);
+	return task ? task->current_priority : SCHEDULER_NUM_TASK_PRIORITIES;
+}
+
+static unsigned long sched_futex_inherited_priority(struct task *task)
+{
+	/* The base priority boosted by the best waiter of every contended PI futex the task owns */
+	unsigned long priority = task->base_priority;
+	struct futex *owned;
+	sched_list_for_each_entry(owned, &task->owned_futexes, owned) {
+		unsigned long highest_waiter = sched_futex_highest_priority(owned->value);
+		if (highest_waiter < priority)
+			priority = highest_waiter;
 	}
+
+	return priority;
+}
+
+static void sched_futex_propagate_priority(struct futex *futex)
+{
+	/* Walk the owner chain while priorities change, the depth limit bounds the time holding the scheduler lock and breaks deadlock cycles */
+	for (unsigned long depth = 0; futex != 0 && depth < SCHEDULER_PI_MAX_DEPTH; ++depth) {
+
+		/* The owner can not release a contended futex without the scheduler lock */
+		struct task *owner = (struct task *)(*futex->value & ~SCHEDULER_FUTEX_CONTENTION_TRACKING);
+		if (!owner)
+			break;
+
+		assert(owner->marker == SCHEDULER_TASK_MARKER);
+
+		/* Nothing further down the chain changes if the owner priority does not, the EDF band also orders by owned futexes */
+		unsigned long priority = sched_futex_inherited_priority(owner);
+		if (priority == owner->current_priority && priority != SCHEDULER_EDF_PRIORITY)
+			break;
+		sched_queue_reprioritize(owner, priority);
+
+		/* Is the owner itself blocked on a PI futex? */
+		futex = owner->blocked_on;
+	}
+}
+
+static void sched_futex_waitv_cancel(struct task *task)
+{
+	/* Leave every address of a vectored wait, the bucket counts only let wakers skip the service */
+	for (unsigned long i = 0; i < task->waitv_count; ++i) {
+		struct sched_futex_bucket *bucket = sched_futex_bucket(task->waitv[i].addr);
+		sched_list_remove(&task->waitv[i].node);
+		atomic_fetch_sub(&bucket->vectored, 1);
+		atomic_fetch_sub(&bucket->waiters, 1);
+	}
+	task->waitv = 0;
+	task->waitv_count = 0;
+}
+
+static void sched_futex_cancel_wait(struct task *task)
+{
+	/* A vectored waiter is not on any bucket queue, just drop its addresses */
+	sched_futex_waitv_cancel(task);
+
+	/* A PI waiter leaving without being woken may have been boosting the owner chain */
+	struct futex *futex = task->blocked_on;
+	task->blocked_on = 0;
+	sched_futex_propagate_priority(futex);
 }
 
 static inline __always_inline bool is_interrupt_context(void)
@@ -349,98 +828,456 @@ static inline __always_inline bool is_svc_context(void)
 
 static inline __always_inline bool scheduler_check_stack(struct task *task)
 {
+#if SCHEDULER_MPU_GUARD
+	/* Overflows fault on the guard region instead */
+	return true;
+#else
 	return ((task->flags & SCHEDULER_TASK_STACK_CHECK) == 0) || (task->stack_marker[0] == SCHEDULER_STACK_MARKER && task->stack_marker[1] == SCHEDULER_STACK_MARKER);
+#endif
 }
 
-static void scheduler_timer_push(struct task *task, uint32_t delay)
+static inline __always_inline void scheduler_stack_guard(struct task *task)
 {
-	assert(task != 0);
+#if SCHEDULER_MPU_GUARD
+	/* Make sure the MPU is running, the default map covers everything but the guard */
+	if ((MPU->CTRL & MPU_CTRL_ENABLE_Msk) == 0)
+		MPU->CTRL = MPU_CTRL_PRIVDEFENA_Msk | MPU_CTRL_ENABLE_Msk;
 
-	/* Remove any existing timers */
-	sched_list_remove(&task->timer_node);
+	/* Drop the old guard */
+	MPU->RNR = SCHEDULER_MPU_GUARD_REGION;
+	MPU->RASR = 0;
 
-	/* Initialize the timer */
-	task->timer_expires = scheduler_get_ticks() + delay;
+	/* Guard the bytes below the stack with the matching 32 byte subregions of a 256 byte region, the guard is aligned to its size so it never straddles two */
+	if (task && (task->flags & SCHEDULER_TASK_STACK_CHECK)) {
+		uintptr_t guard = (uintptr_t)task->stack_marker - SCHEDULER_MPU_GUARD_SIZE;
+		uint32_t disabled = ~(((1UL << (SCHEDULER_MPU_GUARD_SIZE / 32)) - 1) << ((guard >> 5) & 0x7)) & 0xff;
+		MPU->RBAR = guard & ~0xffUL;
+		MPU->RASR = MPU_RASR_XN_Msk | (disabled << MPU_RASR_SRD_Pos) | (7UL << MPU_RASR_SIZE_Pos) | MPU_RASR_ENABLE_Msk;
+	}
 
-	/* Find the insert point */
-	struct task *entry;
-	sched_list_for_each_entry(entry, &scheduler->timers, timer_node)
-		if (entry->timer_expires > task->timer_expires)
-			break;
+	/* Must be in place before the exception return */
+	__DSB();
+	__ISB();
+#endif
+}
 
-	/* Insert at the correct position, which might be the head */
-	sched_list_insert_before(&entry->timer_node, &task->timer_node);
+static void scheduler_stack_watermark(struct task *task)
+{
+	/* Only checked stacks are painted */
+	if ((task->flags & SCHEDULER_TASK_STACK_CHECK) == 0)
+		return;
 
-	/* Update the new timer expire */
-	unsigned long closest = sched_list_first_entry(&scheduler->timers, struct task, timer_node)->timer_expires;
+	/* The saved frame of a task about to run bounds its stack usage from below, when it is on the task stack */
+	unsigned long *low = (unsigned long *)task->psp;
+	if (low > task->stack_low || low < task->stack_marker)
+		low = task->stack_low;
+
+	/* Usage between switches shows up as overwritten paint, follow it down a few words at a time */
+	unsigned long *pos = low < task->stack_painted ? low : task->stack_painted;
+	for (unsigned long count = 0; count < SCHEDULER_STACK_PAINT_WORDS && pos > task->stack_marker && pos[-1] != SCHEDULER_STACK_MARKER; ++count)
+		--pos;
+	if (pos < low)
+		low = pos;
+
+	/* Paint a little more of the stack below the low water mark, working up from the guard */
+	unsigned long *paint = task->stack_painted;
+	for (unsigned long count = 0; count < SCHEDULER_STACK_PAINT_WORDS && paint < low; ++count)
+		*paint++ = SCHEDULER_STACK_MARKER;
 
-	/* Save it */
-	scheduler->timer_expires = closest;
+	task->stack_painted = paint;
+	task->stack_low = low;
+}
+
+static void sched_timer_wheel_init(struct sched_timer_wheel *wheel)
+{
+	assert(wheel != 0);
+
+	wheel->now = 0;
+	wheel->armed = 0;
+	sched_list_init(&wheel->expired);
+	for (unsigned long level = 0; level < SCHEDULER_TIMER_WHEEL_LEVELS; ++level) {
+		wheel->occupied[level] = 0;
+		for (unsigned long slot = 0; slot < SCHEDULER_TIMER_WHEEL_SLOTS; ++slot)
+			sched_list_init(&wheel->slots[level][slot]);
+	}
+}
+
+static void sched_timer_wheel_insert(struct sched_timer_wheel *wheel, struct task *task)
+{
+	uint32_t expires = task->timer_expires;
+
+	/* Already due? */
+	if (expires == wheel->now) {
+		sched_list_push(&wheel->expired, &task->timer_node);
+		return;
+	}
+
+	/* The lowest level where all the higher digits of the expiry match the wheel time */
+	uint32_t differ = expires ^ wheel->now;
+	unsigned long level = 0;
+	while (level < SCHEDULER_TIMER_WHEEL_LEVELS - 1 && (differ >> (SCHEDULER_TIMER_WHEEL_BITS * (level + 1))) != 0)
+		++level;
+
+	/* Drop into the slot matching the digit at this level */
+	unsigned long slot = (expires >> (SCHEDULER_TIMER_WHEEL_BITS * level)) & (SCHEDULER_TIMER_WHEEL_SLOTS - 1);
+	sched_list_push(&wheel->slots[level][slot], &task->timer_node);
+	wheel->occupied[level] |= 1UL << slot;
+}
+
+static bool sched_timer_wheel_next(struct sched_timer_wheel *wheel, uint32_t *next, unsigned long *next_level)
+{
+	bool found = false;
+	uint32_t closest = 0;
+
+	for (unsigned long level = 0; level < SCHEDULER_TIMER_WHEEL_LEVELS; ++level) {
+		if (wheel->occupied[level] == 0)
+			continue;
+
+		/* Search upwards from the digit of the wheel time, only the top level wraps around to the slots behind it */
+		unsigned long shift = SCHEDULER_TIMER_WHEEL_BITS * level;
+		unsigned long digit = (wheel->now >> shift) & (SCHEDULER_TIMER_WHEEL_SLOTS - 1);
+		uint32_t ahead = wheel->occupied[level] & ~(uint32_t)((2UL << digit) - 1);
+		unsigned long slot = sched_find_first_set(ahead != 0 ? ahead : wheel->occupied[level]);
+
+		unsigned long span = shift + SCHEDULER_TIMER_WHEEL_BITS;
+		uint32_t base = span >= 32 ? 0 : wheel->now & ~((1UL << span) - 1);
+		uint32_t event = base + ((uint32_t)slot << shift);
+		if (!found || event - wheel->now < closest - wheel->now) {
+			closest = event;
+			*next_level = level;
+			found = true;
+		}
+	}
+
+	*next = closest;
+	return found;
+}
+
+static void sched_timer_wheel_advance(struct sched_timer_wheel *wheel, uint32_t ticks)
+{
+	uint32_t event;
+	unsigned long level;
+
+	/* Jump from event to event, lower level slots expire, higher level slots cascade down */
+	while (sched_timer_wheel_next(wheel, &event, &level) && event - wheel->now <= ticks - wheel->now) {
+
+		wheel->now = event;
+
+		unsigned long slot = (event >> (SCHEDULER_TIMER_WHEEL_BITS * level)) & (SCHEDULER_TIMER_WHEEL_SLOTS - 1);
+		wheel->occupied[level] &= ~(1UL << slot);
+
+		/* Entries are always re-inserted on a lower level or into the expired list */
+		struct task *task;
+		while ((task = sched_list_pop_entry(&wheel->slots[level][slot], struct task, timer_node)) != 0)
+			sched_timer_wheel_insert(wheel, task);
+	}
+
+	/* Nothing else due, catch up with the clock */
+	wheel->now = ticks;
+}
+
+static void scheduler_timer_update_expires(void)
+{
+	struct sched_timer_wheel *wheel = &scheduler->timers;
+	uint32_t event;
+	unsigned long level;
+
+	/* Closest wheel event, could be a cascade or a slot emptied by a cancel, both are cheap to process early */
+	if (wheel->armed == 0)
+		scheduler->timer_expires = UINT32_MAX;
+	else if (!sched_list_empty(&wheel->expired))
+		scheduler->timer_expires = wheel->now;
+	else if (sched_timer_wheel_next(wheel, &event, &level))
+		scheduler->timer_expires = event;
 }
 
 static void scheduler_timer_remove(struct task *task)
 {
 	assert(task != 0);
 
+	/* Not armed? */
+	if (!sched_list_is_linked(&task->timer_node))
+		return;
+
+	/* The slot bit is cleared lazily when the wheel reaches it */
 	sched_list_remove(&task->timer_node);
+	if (--scheduler->timers.armed == 0) {
+		for (unsigned long level = 0; level < SCHEDULER_TIMER_WHEEL_LEVELS; ++level)
+			scheduler->timers.occupied[level] = 0;
+		scheduler->timer_expires = UINT32_MAX;
+	}
+}
+
+static void scheduler_timer_push_at(struct task *task, uint32_t expires)
+{
+	struct sched_timer_wheel *wheel = &scheduler->timers;
+
+	assert(task != 0);
+
+	/* Remove any existing timers */
+	scheduler_timer_remove(task);
+
+	/* An empty wheel can jump straight to the current time */
+	unsigned long ticks = scheduler_get_ticks();
+	if (wheel->armed == 0)
+		wheel->now = ticks;
+
+	/* A deadline already passed is due now, the wheel resolves half the tick range and longer delays expire early */
+	if ((int32_t)(expires - ticks) < 0)
+		expires = ticks;
+	else if (expires - (uint32_t)ticks > DELAY_MAX)
+		expires = ticks + DELAY_MAX;
+
+	/* Initialize the timer and add it to the wheel */
+	task->timer_expires = expires;
+	sched_timer_wheel_insert(wheel, task);
+	++wheel->armed;
 
 	/* Update the new timer expire */
-	unsigned long closest = sched_list_empty(&scheduler->timers) ? UINT_MAX : sched_list_first_entry(&scheduler->timers, struct task, timer_node)->timer_expires;
+	scheduler_timer_update_expires();
+}
+
+static void scheduler_timer_push(struct task *task, uint32_t delay)
+{
+	/* The wheel resolves half the tick range, longer delays expire early */
+	if (delay > DELAY_MAX)
+		delay = DELAY_MAX;
 
-	/* Save it */
-	scheduler->timer_expires = closest;
+	scheduler_timer_push_at(task, scheduler_get_ticks() + delay);
 }
 
 static struct task *scheduler_timer_pop(void)
 {
-	struct task *task = 0;
+	struct sched_timer_wheel *wheel = &scheduler->timers;
 
-	/* Is the timer list empty? */
-	if (!sched_list_empty(&scheduler->timers)) {
+	/* Nothing armed or not yet due? */
+	if (wheel->armed == 0 || (int32_t)(scheduler_get_ticks() - scheduler->timer_expires) < 0)
+		return 0;
 
-		/* Check for expired timer */
-		task = sched_list_first_entry(&scheduler->timers, struct task, timer_node);
-		if (task->timer_expires <= scheduler_get_ticks())
-			scheduler_timer_remove(task);
-		else
-			task = 0;
+	/* Run the wheel forward if all the expired timers have been handed out */
+	if (sched_list_empty(&wheel->expired)) {
+		sched_timer_wheel_advance(wheel, scheduler_get_ticks());
+		scheduler_timer_update_expires();
+	}
+
+	/* Hand out the next expired timer */
+	struct task *task = sched_list_empty(&wheel->expired) ? 0 : sched_list_first_entry(&wheel->expired, struct task, timer_node);
+	if (task) {
+		sched_trace(SCHED_TRACE_TIMER_EXPIRE, task, 0, task->timer_expires);
+		scheduler_timer_remove(task);
 	}
 
 	/* No expired timers */
 	return task;
 }
 
+__weak unsigned long scheduler_tick_delay_hook(unsigned long ticks)
+{
+	/* By default the tick hook does not need to run in tickless mode */
+	return SCHEDULER_WAIT_FOREVER;
+}
+
 __weak unsigned long scheduler_get_ticks(void)
 {
 	/* By default we use the core 0 ticks as the reference */
 	return cls_datum_core(0, ticks);
 }
 
+__weak unsigned long long scheduler_get_ticks64(void)
+{
+	unsigned long sequence;
+	unsigned long epoch;
+	unsigned long count;
+
+	/* Readers never block, they only retry when core 0 was in the middle of a tick */
+	do {
+		sequence = atomic_load_explicit(&ticks_sequence, memory_order_acquire);
+		epoch = atomic_load_explicit(&ticks_epoch, memory_order_relaxed);
+		count = *(volatile unsigned long *)cls_datum_core_ptr(0, ticks);
+
+		/* The reads above must complete before the sequence is checked again */
+		atomic_thread_fence(memory_order_acquire);
+
+	} while ((sequence & 1) != 0 || atomic_load_explicit(&ticks_sequence, memory_order_relaxed) != sequence);
+
+	/* An add rather than an or, the count never wraps where an unsigned long is 64 bits */
+	return ((unsigned long long)epoch << 32) + count;
+}
+
+unsigned long scheduler_idle_ticks(void)
+{
+	unsigned long ticks = scheduler_get_ticks();
+	unsigned long idle = scheduler_tick_delay_hook(ticks);
+
+	/* Ticks until the closest armed timer, a racy read only shortens or lengthens a sleep estimate */
+	unsigned long timer_expires = scheduler->timer_expires;
+	if (scheduler->timers.armed != 0) {
+		unsigned long timer_delay = (int32_t)(timer_expires - ticks) > 0 ? timer_expires - ticks : 0;
+		if (timer_delay < idle)
+			idle = timer_delay;
+	}
+
+	return idle;
+}
+
+static inline bool scheduler_slice_enabled(const struct task *task)
+{
+	return task != 0 && task->quantum != INT32_MAX;
+}
+
+static void scheduler_update_wakeup(void *cls)
+{
+#if SCHEDULER_TICKLESS
+	unsigned long ticks = scheduler_get_ticks();
+	unsigned long delay = scheduler_tick_delay_hook(ticks);
+
+	/* Closest of the tick hook, the timer wheel and the time slice of this core */
+	if (scheduler->timers.armed != 0) {
+		unsigned long timer_delay = (int32_t)(scheduler->timer_expires - ticks) > 0 ? scheduler->timer_expires - ticks : 0;
+		if (timer_delay < delay)
+			delay = timer_delay;
+	}
+	if (scheduler_slice_enabled(cls_datum_at(cls, current_task))) {
+		unsigned long slice_delay = (int32_t)(cls_datum_at(cls, slice_expires) - ticks) > 0 ? cls_datum_at(cls, slice_expires) - ticks : 0;
+		if (slice_delay < delay)
+			delay = slice_delay;
+	}
+
+	/* Let the glue program the alarm of this core */
+	scheduler_tickless_hook(delay);
+#endif
+}
+
 __fast_section __optimize void scheduler_tick(void)
 {
 	/* Someone may have enabled us too early, ignore */
 	if (!scheduler_is_running())
 		return;
 
-	/* Update the core tick count */
-	++cls_datum(ticks);
+	/* Resolve the core local block once for the whole tick */
+	void *cls = cls_ptr();
+
+#if !SCHEDULER_TICKLESS
+	/* Update the core tick count, in tickless mode the glue provides the ticks */
+	if (scheduler_current_core() == 0) {
+
+		/* Core 0 is the reference, extend its count for 64-bit readers on either core */
+		unsigned int state = disable_interrupts();
+		atomic_fetch_add_explicit(&ticks_sequence, 1, memory_order_relaxed);
+		atomic_thread_fence(memory_order_release);
+		if (++*(volatile unsigned long *)&cls_datum_at(cls, ticks) == 0)
+			atomic_fetch_add_explicit(&ticks_epoch, 1, memory_order_relaxed);
+		atomic_fetch_add_explicit(&ticks_sequence, 1, memory_order_release);
+		enable_interrupts(state);
+
+	} else
+		++cls_datum_at(cls, ticks);
+#endif
 
 	/* Get data for tick handling, we use the API to allow a single tick truth */
 	unsigned long timer_expires = scheduler->timer_expires;
 	unsigned long ticks = scheduler_get_ticks();
 
+	sched_trace(SCHED_TRACE_TICK, 0, 0, ticks);
+
 	/* Check for expired timer */
-	if (timer_expires <= ticks)
+	if (scheduler->timers.armed != 0 && (int32_t)(ticks - timer_expires) >= 0)
 		scheduler_request_switch(scheduler_current_core());
 
 	/* And time slice enabled and expired */
-	if (cls_datum(slice_expires) != INT32_MAX && --cls_datum(slice_expires) == 0)
+	if (scheduler_slice_enabled(cls_datum_at(cls, current_task)) && (int32_t)(ticks - cls_datum_at(cls, slice_expires)) >= 0)
+		scheduler_request_switch(scheduler_current_core());
+
+	/* Periodically let the switch pull work from overloaded cores */
+	if (scheduler_num_cores() > 1 && ticks % SCHEDULER_BALANCE_TICKS == 0 && sched_ready_imbalanced(scheduler_current_core()))
 		scheduler_request_switch(scheduler_current_core());
 
 	/* Pass to the hook */
 	scheduler_tick_hook(ticks);
 }
 
+static inline void sched_task_list_add(struct task *task)
+{
+	/* Every task on the list is alive, only the ones without SCHEDULER_IGNORE_VIABLE keep the scheduler running */
+	sched_list_push(&scheduler->tasks, &task->scheduler_node);
+	if ((task->flags & SCHEDULER_IGNORE_VIABLE) == 0)
+		++scheduler->viable_tasks;
+}
+
+static inline void sched_task_list_remove(struct task *task)
+{
+	sched_list_remove(&task->scheduler_node);
+	if ((task->flags & SCHEDULER_IGNORE_VIABLE) == 0)
+		--scheduler->viable_tasks;
+}
+
+static int scheduler_task_slot_alloc(struct task *task)
+{
+	/* Table full? */
+	if (scheduler->free_task_slots == 0)
+		return -EAGAIN;
+
+	/* Take the most recently released slot */
+	unsigned long slot = scheduler->task_slots[--scheduler->free_task_slots];
+	scheduler->task_table[slot] = task;
+	task->slot = slot;
+
+	return 0;
+}
+
+static int sched_edf_admit(struct task *task)
+{
+	unsigned long capacity = SCHEDULER_EDF_CAPACITY * SCHEDULER_EDF_UTILISATION_SCALE / 100;
+
+	/* Pinned tasks must fit on their core, the others go to the least loaded core they fit on */
+	unsigned long selected = UINT32_MAX;
+	for (unsigned long core = 0; core < scheduler_num_cores(); ++core) {
+		if ((task->flags & SCHEDULER_CORE_AFFINITY) && core != task->affinity)
+			continue;
+		if (scheduler->edf_utilisation[core] + task->edf_utilisation > capacity)
+			continue;
+		if (selected == UINT32_MAX || scheduler->edf_utilisation[core] < scheduler->edf_utilisation[selected])
+			selected = core;
+	}
+
+	/* Would miss deadlines */
+	if (selected == UINT32_MAX)
+		return -EBUSY;
+
+	/* Partitioned, the task stays on the core it was admitted to */
+	scheduler->edf_utilisation[selected] += task->edf_utilisation;
+	task->affinity = selected;
+	atomic_fetch_or(&task->flags, SCHEDULER_CORE_AFFINITY);
+
+	/* The first job is released now */
+	task->edf_release = scheduler_get_ticks();
+	task->edf_deadline = task->edf_release + task->edf_relative_deadline;
+
+	return 0;
+}
+
+static void sched_edf_release(struct task *task)
+{
+	/* Only admitted tasks have a utilisation */
+	if (task->edf_utilisation != 0) {
+		scheduler->edf_utilisation[task->affinity] -= task->edf_utilisation;
+		task->edf_utilisation = 0;
+	}
+}
+
+static void scheduler_task_slot_release(struct task *task)
+{
+	assert(task->slot < SCHEDULER_MAX_TASKS && scheduler->task_table[task->slot] == task);
+
+	/* Return the slot to the free stack */
+	scheduler->task_table[task->slot] = 0;
+	scheduler->task_slots[scheduler->free_task_slots++] = task->slot;
+	task->slot = SCHEDULER_MAX_TASKS;
+
+	/* And the core share of EDF tasks */
+	sched_edf_release(task);
+}
+
 void scheduler_create_svc(struct exception_frame *frame)
 {
 	assert(frame->r0 != 0 && scheduler != 0);
@@ -449,115 +1286,182 @@ void scheduler_create_svc(struct exception_frame *frame)
 
 	scheduler_spin_lock();
 
-	assert(task->marker == SCHEDULER_TASK_MARKER);
+	assert(task->marker == SCHEDULER_TASK_MARKER);
+
+	/* EDF tasks must pass admission control first */
+	if (task->edf_utilisation != 0) {
+		int status = sched_edf_admit(task);
+		if (status < 0) {
+			frame->r0 = status;
+			scheduler_spin_unlock();
+			return;
+		}
+	}
+
+	/* Claim a slot in the task table */
+	int status = scheduler_task_slot_alloc(task);
+	if (status < 0) {
+		sched_edf_release(task);
+		frame->r0 = status;
+		scheduler_spin_unlock();
+		return;
+	}
 
 	/* Add the task the scheduler list */
-	sched_list_push(&scheduler->tasks, &task->scheduler_node);
+	sched_task_list_add(task);
 
 	/* Add the new task to the ready queue */
 	if ((task->flags & SCHEDULER_CREATE_SUSPENDED) == 0) {
 
 		/* Ready the task */
 		task->state = TASK_READY;
-		sched_queue_push(&scheduler->ready_queue, task);
+		sched_ready_push(task);
 
 		/* Since we pushed the task onto the ready queue, do a context switch and return the new task */
-		if (scheduler_is_running() && task->current_priority < sched_get_current()->current_priority)
+		if (scheduler_is_running() && sched_ready_preempts(task, sched_get_current()))
 			scheduler_request_switch(scheduler_current_core());
 
 	} else
 		/* Mark as suspended */
 		task->state = TASK_SUSPENDED;
 
+	/* The task pointer is still in r0, it is not a status */
+	frame->r0 = 0;
 
 	scheduler_spin_unlock();
 }
 
 void scheduler_yield_svc(struct exception_frame *frame)
 {
-	/* Pend the context switch to switch to the next task */
+	/* Pend the context switch to switch to the next task, giving up the core counts as a voluntary switch */
+	cls_datum(yield_pending) = true;
 	scheduler_request_switch(scheduler_current_core());
 }
 
 static int scheduler_task_alive(const struct task *task)
 {
-	if (task != 0) {
-		struct sched_list *current = 0;
-		sched_list_for_each(current , &scheduler->tasks)
-			if (&task->scheduler_node == current)
-				return 0;
-	}
+	/* A stale handle can hold any slot number, so range check it before the table lookup */
+	if (task != 0 && task->slot < SCHEDULER_MAX_TASKS && scheduler->task_table[task->slot] == task)
+		return 0;
 
 	/* Not alive */
 	return -ESRCH;
 }
 
+static int scheduler_lock_task(struct task *task, struct sched_futex_bucket **bucket)
+{
+	assert(bucket != 0);
+
+	*bucket = 0;
+
+	scheduler_spin_lock();
+
+	while (true) {
+
+		/* Make sure the task is alive */
+		int status = scheduler_task_alive(task);
+		if (status != 0) {
+			scheduler_spin_unlock();
+			return status;
+		}
+
+		/* Only tasks blocked on a futex need the bucket lock, the wait address can not change while we hold the scheduler lock */
+		if (task->state != TASK_BLOCKED || task->wait_addr == 0)
+			return 0;
+
+		/* Try out of order first */
+		long *wait_addr = task->wait_addr;
+		*bucket = sched_futex_bucket(wait_addr);
+		if (spin_try_lock(&(*bucket)->lock))
+			return 0;
+
+		/* Back off and take the locks in order */
+		scheduler_spin_unlock();
+		spin_lock(&(*bucket)->lock);
+		scheduler_spin_lock();
+
+		/* Still blocked on the same futex? */
+		if (scheduler_task_alive(task) == 0 && task->state == TASK_BLOCKED && task->wait_addr == wait_addr)
+			return 0;
+
+		/* Try again */
+		spin_unlock(&(*bucket)->lock);
+		*bucket = 0;
+	}
+}
+
+static void scheduler_unlock_task(struct sched_futex_bucket *bucket)
+{
+	scheduler_spin_unlock();
+	if (bucket)
+		spin_unlock(&bucket->lock);
+}
+
 void scheduler_suspend_svc(struct scheduler_frame *frame)
 {
 	struct task *current = sched_get_current();
 	struct task *task = (struct task *)frame->r0;
 	unsigned long ticks = frame->r1;
+	bool absolute = frame->r2;
+	struct sched_futex_bucket *bucket;
 
-	/* Close the dog house door */
-	scheduler_spin_lock();
-
-	/* Make sure the task is alive */
-	frame->r0 = scheduler_task_alive(task);
-	if (frame->r0 != 0) {
-		scheduler_spin_unlock();
+	/* Close the dog house door, make sure the task is alive */
+	frame->r0 = scheduler_lock_task(task, &bucket);
+	if (frame->r0 != 0)
 		return;
-	}
+
+	/* We need a context switch, the current task leaves the core before another one can run it */
+	current->psp = frame;
+	sched_set_current(0);
 
 	/* Who are we suspending */
 	if (task != current) {
 
-		/* Remove task from any blocked queues and timeouts */
+		/* Remove task from any ready queue and mark as suspended, a ready task also needs the lock of its queue */
+		struct sched_ready_queue *owner = sched_ready_lock_task(task);
 		sched_queue_remove(task);
-		scheduler_timer_remove(task);
-
-		/* Mark as suspended */
 		task->state = TASK_SUSPENDED;
 		task->core = UINT32_MAX;
+		if (owner)
+			spin_unlock(&owner->lock);
+
+		/* Remove task from any blocked queues and timeouts */
+		sched_futex_cancel_wait(task);
+		scheduler_timer_remove(task);
 
 		/* Since a scheduler frame was create we always need a context switch */
 		current->state = TASK_READY;
-		sched_queue_push(&scheduler->ready_queue, current);
+		sched_ready_push(current);
 
 	} else {
 
 		/* Suspending ourselves, add to the suspend queue */
 		current->state = TASK_SUSPENDED;
 		current->core = UINT32_MAX;
+		++current->voluntary_switches;
 	}
 
-	/* Add any need timer */
-	if (ticks < SCHEDULER_WAIT_FOREVER)
+	/* Add any need timer, an absolute deadline is resolved here so preemption on the way in does not add to it */
+	if (absolute)
+		scheduler_timer_push_at(task, ticks);
+	else if (ticks < SCHEDULER_WAIT_FOREVER)
 		scheduler_timer_push(task, ticks);
 
-	/* We need a context switch */
-	current->psp = frame;
-	sched_set_current(0);
 	scheduler_request_switch(scheduler_current_core());
 
 	/* Unleash the dogs */
-	scheduler_spin_unlock();
+	scheduler_unlock_task(bucket);
 }
 
 void scheduler_resume_svc(struct exception_frame *frame)
 {
 	struct task *task = (struct task *)frame->r0;
-
-	/* We should be could */
-	frame->r0 = 0;
-
-	scheduler_spin_lock();
+	struct sched_futex_bucket *bucket;
 
 	/* Make sure the task is alive */
-	frame->r0 = scheduler_task_alive(task);
-	if (frame->r0 != 0) {
-		scheduler_spin_unlock();
+	frame->r0 = scheduler_lock_task(task, &bucket);
+	if (frame->r0 != 0)
 		return;
-	}
 
 	assert(task != 0 && task->marker == SCHEDULER_TASK_MARKER);
 
@@ -570,6 +1474,7 @@ void scheduler_resume_svc(struct exception_frame *frame)
 
 		/* Remove any blocking queue */
 		sched_queue_remove(task);
+		sched_futex_cancel_wait(task);
 
 		/* Waiting tasks return -ECANCELED when the wait is broken via resume */
 		if (task->state == TASK_BLOCKED)
@@ -577,14 +1482,14 @@ void scheduler_resume_svc(struct exception_frame *frame)
 
 		/* Push on the ready queue */
 		task->state = TASK_READY;
-		sched_queue_push(&scheduler->ready_queue, task);
+		sched_ready_push(task);
 
 	} else
 		frame->r0 = -EINVAL;
 
 	/* Request a context switch */
 	scheduler_request_switch(scheduler_current_core());
-	scheduler_spin_unlock();
+	scheduler_unlock_task(bucket);
 }
 
 void scheduler_wait_svc(struct scheduler_frame *frame)
@@ -593,26 +1498,42 @@ void scheduler_wait_svc(struct scheduler_frame *frame)
 	long expected = (long)frame->r1;
 	long value = (futex->flags & SCHEDULER_FUTEX_CONTENTION_TRACKING) ? expected | (long)SCHEDULER_FUTEX_CONTENTION_TRACKING : expected;
 	unsigned long ticks = frame->r2;
+	bool absolute = frame->r3;
 	struct task *current = sched_get_current();
 
-	scheduler_spin_lock();
-
 	assert(futex != 0 && futex->marker == SCHEDULER_FUTEX_MARKER && current != 0);
 
+	/* The value check and the queueing are atomic with respect to wakers of this bucket only */
+	struct sched_futex_bucket *bucket = sched_futex_bucket(futex->value);
+	spin_lock(&bucket->lock);
+
 	/* At this point assume no timeout */
 	frame->r0 = 0;
+	current->psp = frame;
+
+	/* Count ourselves before checking the value, a waker changes the value before checking the count */
+	atomic_fetch_add(&bucket->waiters, 1);
 
 	/* Should we block? The second clause prevents a wakeup when the futex becomes contended while on the way into the wait */
 	if (atomic_compare_exchange_strong(futex->value, &expected, value) || expected == value) {
 
+		scheduler_spin_lock();
+
 		/* Add a timeout if requested */
-		if (ticks < SCHEDULER_WAIT_FOREVER)
+		if (absolute)
+			scheduler_timer_push_at(current, ticks);
+		else if (ticks < SCHEDULER_WAIT_FOREVER)
 			scheduler_timer_push(current, ticks);
 
 		/* Add to the waiter queue */
+		sched_set_current(0);
 		current->state = TASK_BLOCKED;
 		current->core = UINT32_MAX;
-		sched_queue_push(&futex->waiters, current);
+		current->wait_addr = futex->value;
+		current->wait_flags = futex->flags;
+		sched_queue_push(&bucket->queue, current);
+		sched_trace(SCHED_TRACE_WAIT, current, 1, (uintptr_t)futex->value);
+		++current->voluntary_switches;
 
 		/* Was priority inheritance requested */
 		if ((futex->flags & (SCHEDULER_FUTEX_PI | SCHEDULER_FUTEX_OWNER_TRACKING)) == (SCHEDULER_FUTEX_PI | SCHEDULER_FUTEX_OWNER_TRACKING)) {
@@ -625,36 +1546,81 @@ void scheduler_wait_svc(struct scheduler_frame *frame)
 			if (!sched_list_is_linked(&futex->owned))
 				sched_list_add(&owner->owned_futexes, &futex->owned);
 
-			/* Do we need to boost the priority of the futex owner? */
-			unsigned long highest_priority = sched_queue_highest_priority(&futex->waiters);
-			if (highest_priority < owner->current_priority)
-				sched_queue_reprioritize(owner, highest_priority);
+			/* Boost the owner and anything it is blocked behind */
+			current->blocked_on = futex;
+			sched_futex_propagate_priority(futex);
 		}
 
 	} else {
 
 		/* Futex already triggered, we will need a need to complete for the processor */
+		atomic_fetch_sub(&bucket->waiters, 1);
+		scheduler_spin_lock();
+		sched_trace(SCHED_TRACE_WAIT, current, 0, (uintptr_t)futex->value);
+		sched_set_current(0);
 		current->state = TASK_READY;
-		sched_queue_push(&scheduler->ready_queue, current);
+		sched_ready_push(current);
 	}
 
-
-	/* Always perform a context switch  */
-	current->psp = frame;
-	sched_set_current(0);
+	/* Always perform a context switch, the task already left the core as another one may run it once it is queued */
 	scheduler_request_switch(scheduler_current_core());
 
 	/* The dogs are loose */
 	scheduler_spin_unlock();
+	spin_unlock(&bucket->lock);
+}
+
+static int scheduler_wake_vectored(const long *addr, struct sched_futex_bucket *bucket)
+{
+	int woken = 0;
+
+	/* The count is raised before the values are checked, so nobody can be on the way into a vectored wait on this bucket */
+	if (atomic_load(&bucket->vectored) == 0)
+		return 0;
+
+	scheduler_spin_lock();
+
+	/* Vectored waiters are woken on top of the count, a waiter losing the race for the object just waits again, without an address wake them all */
+	struct futex_waitv *waiter;
+	struct futex_waitv *next;
+	sched_list_for_each_entry_mutable(waiter, next, &bucket->waitv, node) {
+
+		if (addr && waiter->addr != addr)
+			continue;
+
+		struct task *task = waiter->task;
+		assert(task->marker == SCHEDULER_TASK_MARKER);
+
+		/* Leaving unlinks the other entries of the task, which can follow in this bucket too */
+		while (&next->node != &bucket->waitv && next->task == task)
+			next = sched_list_next_entry(next, node);
+
+		/* Report which address fired and leave all of them */
+		sched_trace(SCHED_TRACE_WAKE, task, 0, (uintptr_t)waiter->addr);
+		task->psp->r0 = waiter - task->waitv;
+		sched_futex_waitv_cancel(task);
+
+		/* Adjust queue */
+		scheduler_timer_remove(task);
+		task->state = TASK_READY;
+		sched_ready_push(task);
+		++woken;
+	}
+
+	scheduler_spin_unlock();
+
+	return woken;
 }
 
-static int scheduler_wake_futex(struct futex *futex, bool all)
+static int scheduler_wake_futex(struct futex *futex, unsigned long count)
 {
 	int woken = 0;
 
-	/* If a PI futex, adjust priority current owner */
+	/* If a PI futex, adjust priority current owner. The caller holds the bucket lock, the scheduler lock is only needed to move tasks and priorities */
 	if ((futex->flags & (SCHEDULER_FUTEX_PI | SCHEDULER_FUTEX_OWNER_TRACKING)) == (SCHEDULER_FUTEX_PI | SCHEDULER_FUTEX_OWNER_TRACKING)) {
 
+		scheduler_spin_lock();
+
 		/* Extract the owning task */
 		struct task *owner = (struct task *)(*futex->value & ~SCHEDULER_FUTEX_CONTENTION_TRACKING);
 		assert(owner->marker == SCHEDULER_TASK_MARKER);
@@ -662,52 +1628,63 @@ static int scheduler_wake_futex(struct futex *futex, bool all)
 		/* Remove the this futex from the owned list */
 		sched_list_remove(&futex->owned);
 
-		/* Now find the highest priority of remaining owned PI futexes */
-		unsigned long highest_priority = owner->base_priority;
-		struct futex *owned;
-		sched_list_for_each_entry(owned, &owner->owned_futexes, owned) {
-			unsigned long highest_waiter = sched_queue_highest_priority(&owned->waiters);
-			if (highest_waiter < highest_priority)
-				highest_priority = highest_waiter;
-		}
+		/* Drop back to the highest priority of remaining owned PI futexes, the owner is running so no chain hangs off it */
+		sched_queue_reprioritize(owner, sched_futex_inherited_priority(owner));
 
-		/* Re-prioritize the task */
-		sched_queue_reprioritize(owner, highest_priority);
+		scheduler_spin_unlock();
 	}
 
-	/* Wake up the waiters */
+	/* Wake up the waiters, searching the bucket does not need the scheduler lock */
 	struct task *task;
-	while ((task = sched_queue_pop(&futex->waiters,UINT32_MAX)) != 0) {
+	while ((task = sched_futex_best_waiter(futex->value)) != 0) {
 
 		assert(task->marker == SCHEDULER_TASK_MARKER);
 
+		scheduler_spin_lock();
+
+		/* Leave the bucket */
+		sched_queue_remove(task);
+		task->blocked_on = 0;
+		bool contended = sched_futex_best_waiter(futex->value) != 0;
+
+		/* Hand over ownership and contention in one store, the new owner can run on another core once the scheduler lock drops */
 		if (futex->flags & SCHEDULER_FUTEX_OWNER_TRACKING)
-			atomic_exchange(futex->value, (long)task);
+			atomic_store(futex->value, (long)task | (contended && (futex->flags & SCHEDULER_FUTEX_CONTENTION_TRACKING) ? (long)SCHEDULER_FUTEX_CONTENTION_TRACKING : 0));
 
 		/* Was priority inheritance requested */
-		if ((futex->flags & SCHEDULER_FUTEX_PI) && !sched_queue_empty(&futex->waiters)) {
+		if ((futex->flags & SCHEDULER_FUTEX_PI) && contended) {
 
 			/* Add the futex to the list of owned, contented futexes */
 			sched_list_add(&task->owned_futexes, &futex->owned);
 
-			/* Adjust the priority of the new owner */
-			sched_queue_reprioritize(task, sched_queue_highest_priority(&futex->waiters));
+			/* Adjust the priority of the new owner, keeping any boost from the other futexes it owns */
+			sched_queue_reprioritize(task, sched_futex_inherited_priority(task));
 		}
 
 		/* Adjust queue */
 		scheduler_timer_remove(task);
 		task->state = TASK_READY;
-		sched_queue_push(&scheduler->ready_queue, task);
+		sched_ready_push(task);
+		sched_trace(SCHED_TRACE_WAKE, task, 0, (uintptr_t)futex->value);
 
-		/* Continue waking more tasks? */
+		scheduler_spin_unlock();
+
+		/* Continue waking more tasks? An owner can only be handed to one */
 		++woken;
-		if (!all || (futex->flags & SCHEDULER_FUTEX_OWNER_TRACKING))
+		if ((unsigned long)woken == count || (futex->flags & SCHEDULER_FUTEX_OWNER_TRACKING))
 			break;
 	}
 
-	/* Update the contention tracking if requested */
-	if (futex->flags & SCHEDULER_FUTEX_CONTENTION_TRACKING) {
-		if (sched_queue_empty(&futex->waiters))
+	/* Vectored waits are only on plain words */
+	if ((futex->flags & SCHEDULER_FUTEX_OWNER_TRACKING) == 0)
+		woken += scheduler_wake_vectored(futex->value, sched_futex_bucket(futex->value));
+
+	/* Owners were handed over above, a release with nobody left to take it unlocks. Otherwise update the contention tracking if requested */
+	if (futex->flags & SCHEDULER_FUTEX_OWNER_TRACKING) {
+		if (woken == 0)
+			atomic_store(futex->value, 0);
+	} else if (futex->flags & SCHEDULER_FUTEX_CONTENTION_TRACKING) {
+		if (!sched_futex_best_waiter(futex->value))
 			atomic_fetch_and(futex->value, ~SCHEDULER_FUTEX_CONTENTION_TRACKING);
 		else
 			atomic_fetch_or(futex->value, SCHEDULER_FUTEX_CONTENTION_TRACKING);
@@ -717,47 +1694,263 @@ static int scheduler_wake_futex(struct futex *futex, bool all)
 	return woken;
 }
 
+static void scheduler_wake_bucket(struct sched_futex_bucket *bucket, unsigned long pending)
+{
+	/* A single address is pending, wake it the normal way */
+	if (pending & ~SCHEDULER_WAKE_MASK) {
+		struct futex futex;
+		scheduler_futex_init(&futex, (long *)(pending & ~SCHEDULER_WAKE_MASK), 0);
+		scheduler_wake_futex(&futex, (pending & SCHEDULER_WAKE_ALL) ? ULONG_MAX : 1);
+		return;
+	}
+
+	/* Addresses collided in the bucket, wake every plain waiter and let them recheck their values */
+	struct task *task;
+	struct task *next;
+	sched_list_for_each_entry_mutable(task, next, &bucket->queue.tasks, queue_node) {
+		if (task->wait_flags == 0) {
+			scheduler_spin_lock();
+			sched_trace(SCHED_TRACE_WAKE, task, 0, (uintptr_t)task->wait_addr);
+			sched_queue_remove(task);
+			scheduler_timer_remove(task);
+			task->state = TASK_READY;
+			sched_ready_push(task);
+			scheduler_spin_unlock();
+		}
+	}
+
+	/* Along with the vectored waiters on any address in the bucket */
+	scheduler_wake_vectored(0, bucket);
+}
+
+static void scheduler_drain_wakes(void)
+{
+	/* Take the whole deferred wake list and drain it in one pass */
+	unsigned long pending_buckets = atomic_exchange(&scheduler->deferred_wakes, 0);
+	while (pending_buckets != 0) {
+
+		/* The link must be read before the pending wake is cleared, an interrupt can relink the bucket after that */
+		struct sched_futex_bucket *bucket = (struct sched_futex_bucket *)pending_buckets;
+		pending_buckets = bucket->wake_next;
+
+		spin_lock(&bucket->lock);
+		scheduler_wake_bucket(bucket, atomic_exchange(&bucket->wake_pending, 0));
+		spin_unlock(&bucket->lock);
+	}
+}
+
 void scheduler_wake_svc(struct exception_frame *frame)
 {
 	struct futex *futex = (struct futex *)frame->r0;
-	bool all = (bool)frame->r1;
-
-	/* All dogs in there cages */
-	scheduler_spin_lock();
+	unsigned long count = frame->r1;
 
 	assert(futex != 0 && futex->marker == SCHEDULER_FUTEX_MARKER);
 
+	/* All dogs in there cages */
+	struct sched_futex_bucket *bucket = sched_futex_bucket(futex->value);
+	spin_lock(&bucket->lock);
+
 	/* Run wake algo */
-	frame->r0 = scheduler_wake_futex(futex, all);
+	frame->r0 = scheduler_wake_futex(futex, count);
+
+	/* Let the fur fly */
+	spin_unlock(&bucket->lock);
 
 	/* Request a context switch if we woke anyone */
 	if (frame->r0 > 0)
 		scheduler_request_switch(scheduler_current_core());
+}
+
+static int scheduler_requeue_futex(long *addr, long expected, struct futex *target)
+{
+	/* The value changed on the way in, let the caller sort it out */
+	if (atomic_load(addr) != expected)
+		return -EAGAIN;
+
+	/* Always wake one waiter */
+	struct futex source;
+	scheduler_futex_init(&source, addr, 0);
+	int woken = scheduler_wake_futex(&source, 1);
+
+	/* The rest can only be requeued behind an owner which will hand the target over, mark it contended so the owner unlock traps */
+	long owner = 0;
+	if ((target->flags & (SCHEDULER_FUTEX_OWNER_TRACKING | SCHEDULER_FUTEX_CONTENTION_TRACKING)) == (SCHEDULER_FUTEX_OWNER_TRACKING | SCHEDULER_FUTEX_CONTENTION_TRACKING)) {
+		owner = atomic_load(target->value);
+		while ((owner & ~SCHEDULER_FUTEX_CONTENTION_TRACKING) != 0 && (owner & SCHEDULER_FUTEX_CONTENTION_TRACKING) == 0)
+			atomic_compare_exchange_strong(target->value, &owner, owner | SCHEDULER_FUTEX_CONTENTION_TRACKING);
+	}
+
+	/* No owner to hand over the target, just wake everyone */
+	struct task *owner_task = (struct task *)(owner & ~SCHEDULER_FUTEX_CONTENTION_TRACKING);
+	if (!owner_task)
+		return woken + scheduler_wake_futex(&source, ULONG_MAX);
+
+	assert(owner_task->marker == SCHEDULER_TASK_MARKER);
+
+	scheduler_spin_lock();
+
+	/* Move the remaining waiters, they keep any timeout */
+	int requeued = 0;
+	struct sched_futex_bucket *source_bucket = sched_futex_bucket(addr);
+	struct sched_futex_bucket *target_bucket = sched_futex_bucket(target->value);
+	struct task *task;
+	struct task *next;
+	sched_list_for_each_entry_mutable(task, next, &source_bucket->queue.tasks, queue_node) {
+		if (task->wait_addr == addr) {
+			sched_queue_remove(task);
+			task->wait_addr = target->value;
+			task->wait_flags = target->flags;
+			task->blocked_on = (target->flags & SCHEDULER_FUTEX_PI) ? target : 0;
+			atomic_fetch_add(&target_bucket->waiters, 1);
+			sched_queue_push(&target_bucket->queue, task);
+			++requeued;
+		}
+	}
+
+	/* Carry over the priority inheritance as if the requeued tasks had waited on the target */
+	if (requeued > 0 && (target->flags & SCHEDULER_FUTEX_PI)) {
+
+		/* Add the futex to the list of owned, contented futexes */
+		if (!sched_list_is_linked(&target->owned))
+			sched_list_add(&owner_task->owned_futexes, &target->owned);
+
+		/* Boost the owner and anything it is blocked behind */
+		sched_futex_propagate_priority(target);
+	}
 
-	/* Let the fur fly */
 	scheduler_spin_unlock();
+
+	return woken + requeued;
 }
 
-void scheduler_terminate_svc(struct exception_frame *frame)
+void scheduler_requeue_svc(struct exception_frame *frame)
+{
+	long *addr = (long *)frame->r0;
+	long expected = (long)frame->r1;
+	struct futex *target = (struct futex *)frame->r2;
+
+	assert(addr != 0 && target != 0 && target->marker == SCHEDULER_FUTEX_MARKER);
+
+	/* Two bucket locks are taken in bucket order */
+	struct sched_futex_bucket *source_bucket = sched_futex_bucket(addr);
+	struct sched_futex_bucket *target_bucket = sched_futex_bucket(target->value);
+	struct sched_futex_bucket *first = source_bucket < target_bucket ? source_bucket : target_bucket;
+	struct sched_futex_bucket *second = source_bucket < target_bucket ? target_bucket : source_bucket;
+	spin_lock(&first->lock);
+	if (second != first)
+		spin_lock(&second->lock);
+
+	/* Wake one and move the rest */
+	int status = scheduler_requeue_futex(addr, expected, target);
+
+	if (second != first)
+		spin_unlock(&second->lock);
+	spin_unlock(&first->lock);
+
+	/* Request a context switch if we woke anyone */
+	if (status > 0)
+		scheduler_request_switch(scheduler_current_core());
+
+	frame->r0 = status;
+}
+
+void scheduler_waitv_svc(struct scheduler_frame *frame)
 {
+	struct futex_waitv *waiters = (struct futex_waitv *)frame->r0;
+	unsigned long count = frame->r1;
+	unsigned long ticks = frame->r2;
+	bool absolute = frame->r3;
 	struct task *current = sched_get_current();
-	struct task *task = (struct task *)frame->r0;
 
+	assert(waiters != 0 && count > 0 && count <= SCHEDULER_FUTEX_WAITV_MAX && current != 0);
+
+	/* At this point assume no timeout */
+	frame->r0 = 0;
+	current->psp = frame;
+
+	/* Count ourselves in every bucket before checking the values, a waker changes the value before checking the counts */
+	for (unsigned long i = 0; i < count; ++i) {
+		struct sched_futex_bucket *bucket = sched_futex_bucket(waiters[i].addr);
+		atomic_fetch_add(&bucket->waiters, 1);
+		atomic_fetch_add(&bucket->vectored, 1);
+	}
+
+	/* Vectored waiters are only searched holding the scheduler lock, which makes the value checks and the linking atomic with respect to wakers */
 	scheduler_spin_lock();
 
+	/* Should we block? Any changed value means that address already fired */
+	unsigned long changed = count;
+	for (unsigned long i = 0; i < count && changed == count; ++i)
+		if (atomic_load(waiters[i].addr) != waiters[i].value)
+			changed = i;
+
+	if (changed == count) {
+
+		/* Link onto every address */
+		for (unsigned long i = 0; i < count; ++i) {
+			waiters[i].task = current;
+			sched_list_push(&sched_futex_bucket(waiters[i].addr)->waitv, &waiters[i].node);
+		}
+		current->waitv = waiters;
+		current->waitv_count = count;
+
+		/* Add a timeout if requested */
+		if (absolute)
+			scheduler_timer_push_at(current, ticks);
+		else if (ticks < SCHEDULER_WAIT_FOREVER)
+			scheduler_timer_push(current, ticks);
+
+		/* Blocked on no single futex */
+		sched_set_current(0);
+		current->state = TASK_BLOCKED;
+		current->core = UINT32_MAX;
+		sched_trace(SCHED_TRACE_WAIT, current, 1, (uintptr_t)waiters[0].addr);
+		++current->voluntary_switches;
+
+	} else {
+
+		/* Already triggered, we will need to compete for the processor */
+		for (unsigned long i = 0; i < count; ++i) {
+			struct sched_futex_bucket *bucket = sched_futex_bucket(waiters[i].addr);
+			atomic_fetch_sub(&bucket->vectored, 1);
+			atomic_fetch_sub(&bucket->waiters, 1);
+		}
+		frame->r0 = -EAGAIN;
+		sched_trace(SCHED_TRACE_WAIT, current, 0, (uintptr_t)waiters[changed].addr);
+		sched_set_current(0);
+		current->state = TASK_READY;
+		sched_ready_push(current);
+	}
+
+	/* Always perform a context switch, the task already left the core as another one may run it once it is queued */
+	scheduler_request_switch(scheduler_current_core());
+
+	/* The dogs are loose */
+	scheduler_spin_unlock();
+}
+
+void scheduler_terminate_svc(struct exception_frame *frame)
+{
+	struct task *current = sched_get_current();
+	struct task *task = (struct task *)frame->r0;
+	struct sched_futex_bucket *bucket;
+
 	/* Make sure the task is alive */
-	frame->r0 = scheduler_task_alive(task);
-	if (frame->r0 != 0) {
-		scheduler_spin_unlock();
+	frame->r0 = scheduler_lock_task(task, &bucket);
+	if (frame->r0 != 0)
 		return;
-	}
 
 	/* Clean up the task */
+	struct sched_ready_queue *owner = sched_ready_lock_task(task);
 	task->state = TASK_TERMINATED;
 	task->core = UINT32_MAX;
 	sched_queue_remove(task);
+	if (owner)
+		spin_unlock(&owner->lock);
+	sched_futex_cancel_wait(task);
 	scheduler_timer_remove(task);
-	sched_list_remove(&task->scheduler_node);
+	sched_task_list_remove(task);
+	scheduler_task_slot_release(task);
 
 	/* Forward to the termination handler */
 	scheduler_terminated_hook(task);
@@ -769,7 +1962,7 @@ void scheduler_terminate_svc(struct exception_frame *frame)
 	}
 
 	/* Release the block */
-	scheduler_spin_unlock();
+	scheduler_unlock_task(bucket);
 }
 
 void scheduler_priority_svc(struct exception_frame *frame)
@@ -788,9 +1981,10 @@ void scheduler_priority_svc(struct exception_frame *frame)
 
 	assert(task->marker == SCHEDULER_TASK_MARKER);
 
+	/* Keep any inherited boost and pass the change along if the task is blocked on a PI futex */
 	task->base_priority = priority;
-	/* if (task->base_priority < task->current_priority) Will the cause a priority inheritance problem????? */
-	sched_queue_reprioritize(task, priority);
+	sched_queue_reprioritize(task, sched_futex_inherited_priority(task));
+	sched_futex_propagate_priority(task->blocked_on);
 
 	/* Let the context switcher sort this out */
 	scheduler_request_switch(scheduler_current_core());
@@ -800,20 +1994,8 @@ void scheduler_priority_svc(struct exception_frame *frame)
 
 static bool scheduler_is_viable(void)
 {
-	bool viable = false;
-
-	/* Well look for blocked tasks schedule task list */
-	struct task *potential_task;
-	sched_list_for_each_entry(potential_task, &scheduler->tasks, scheduler_node) {
-		assert(potential_task->marker == SCHEDULER_TASK_MARKER);
-		if (potential_task->state >= TASK_BLOCKED && (potential_task->flags & SCHEDULER_IGNORE_VIABLE) == 0) {
-			viable = true;
-			break;
-		}
-	}
-
 	/* Not viable, we should be cleanup and shutdown */
-	return viable;
+	return scheduler->viable_tasks != 0;
 }
 
 __weak void scheduler_terminated_hook(struct task *task)
@@ -867,143 +2049,241 @@ __weak void scheduler_request_switch(unsigned long core)
 	__DSB();
 }
 
-struct scheduler_frame *scheduler_switch(struct scheduler_frame *frame)
+static void scheduler_expire_timers(void)
 {
 	struct task *expired;
 
-	assert(scheduler != 0);
+	/* Futex waiters also need their bucket lock, retry on the next pass rather than invert the lock order */
+	struct sched_list retry;
+	sched_list_init(&retry);
+	while((expired = scheduler_timer_pop()) != 0) {
 
-	scheduler_spin_lock();
+		assert(expired->marker == SCHEDULER_TASK_MARKER);
+
+		struct sched_futex_bucket *bucket = 0;
+		if (expired->state == TASK_BLOCKED && expired->wait_addr != 0) {
+			bucket = sched_futex_bucket(expired->wait_addr);
+			if (!spin_try_lock(&bucket->lock)) {
+				sched_list_push(&retry, &expired->timer_node);
+				continue;
+			}
+		}
 
-	/* Get the current task */
-	struct task *task = sched_set_current(0);
-	struct task *last_task = task;
+		/* Remove from any wait queue */
+		sched_queue_remove(expired);
+		sched_futex_cancel_wait(expired);
 
-	/* Only push the current task if we have one and the scheduler is not locked */
-	if (task != 0) {
+		/* Make ready */
+		expired->state = TASK_READY;
+		expired->psp->r0 = (uintptr_t)-ETIMEDOUT;
 
-		assert(task->marker == SCHEDULER_TASK_MARKER && task->state == TASK_RUNNING);
+		/* Add to the ready queue */
+		sched_ready_push(expired);
 
-		/* No switch if scheduler is locked */
-		if (scheduler->locked < 0) {
-			sched_set_current(task);
-			scheduler_spin_unlock();
-			return frame;
-		}
+		if (bucket)
+			spin_unlock(&bucket->lock);
+	}
 
-		/* Force the running task to complete for the processor */
-		task->state = TASK_READY;
-		task->core = UINT32_MAX;
-		task->psp = frame;
-		sched_queue_push(&scheduler->ready_queue, task);
+	/* Re-arm the timers we could not expire */
+	while ((expired = sched_list_pop_entry(&retry, struct task, timer_node)) != 0)
+		scheduler_timer_push(expired, 0);
+}
+
+struct scheduler_frame *scheduler_switch(struct scheduler_frame *frame, void *cls)
+{
+	assert(scheduler != 0);
+
+	/* Resolve the core once for the whole switch, everything below is passed it */
+	unsigned long core = scheduler_current_core();
+	struct sched_ready_queue *local = &scheduler->ready_queue[core];
+
+	/* Any kick to this core is being served, later ones must pend another switch */
+	atomic_fetch_and(&scheduler->kicks_pending, ~(1UL << core));
+
+	/* Get the current task, no switch if the scheduler is locked */
+	struct task *last_task = cls_datum_at(cls, current_task);
+	if (last_task != 0 && scheduler->locked < 0)
+		return frame;
+
+	/* The switch hook only runs once the next task is known */
+	bool yielded = cls_datum_at(cls, yield_pending);
+	cls_datum_at(cls, yield_pending) = false;
+
+	/* Preempted inside its quantum keeps the rest of it, equal priorities only rotate on expiry or yield */
+	if (last_task != 0) {
+		assert(last_task->marker == SCHEDULER_TASK_MARKER);
+		if (!yielded && scheduler_slice_enabled(last_task)) {
+			unsigned long ticks = scheduler_get_ticks();
+			if ((int32_t)(cls_datum_at(cls, slice_expires) - ticks) > 0)
+				last_task->slice_remaining = cls_datum_at(cls, slice_expires) - ticks;
+		}
 	}
 
 	/* Try to get the next task */
+	struct task *current = last_task;
+	struct task *task;
+	bool idle = false;
 	while (true) {
 
-		/* Check for deferred wake ups */
-		for (int i = 0; (cls_datum(taken_wake_counter) ^ cls_datum(given_wake_counter)) != 0 && i < SCHEDULER_MAX_DEFERED_WAKE; ++i) {
-			unsigned long wakeup = atomic_exchange(&cls_datum(deferred_wake)[i], 0);
-			if (wakeup != 0) {
-				scheduler_wake_futex((struct futex *)(wakeup & ~0x00000001), wakeup & 0x00000001);
-				++cls_datum(taken_wake_counter);
+		/* Interrupt wakes need the bucket locks, which come before the scheduler lock */
+		if (atomic_load(&scheduler->deferred_wakes) != 0)
+			scheduler_drain_wakes();
+
+		/* Ready any expired timers, the wheel needs the scheduler lock */
+		if (scheduler->timers.armed != 0 && (int32_t)(scheduler_get_ticks() - scheduler->timer_expires) >= 0) {
+			scheduler_spin_lock();
+			scheduler_expire_timers();
+			scheduler_spin_unlock();
+		}
+
+		/* Everything else only needs our ready queue, unless a task moves between cores */
+		bool all = false;
+		spin_lock(&local->lock);
+
+		/* Force the running task to compete for the processor, unless it was suspended or terminated from another core */
+		if (current != 0) {
+			sched_exchange_current(cls, core, 0);
+			if (current->state == TASK_RUNNING) {
+				unsigned long target = sched_ready_select_core(current, core);
+				if (target != core) {
+					spin_unlock(&local->lock);
+					sched_ready_lock_all();
+					all = true;
+				}
+				current->state = TASK_READY;
+				current->core = UINT32_MAX;
+				current->psp = frame;
+				sched_ready_queue_push(&scheduler->ready_queue[target], current);
 			}
 		}
 
-		/* Ready any expired timers */
-		while((expired = scheduler_timer_pop()) != 0) {
+		/* Publish our priority before peeking at the other queues, a core pushing there checks it after its push */
+		atomic_thread_fence(memory_order_seq_cst);
 
-			assert(expired->marker == SCHEDULER_TASK_MARKER);
+		/* Stealing needs every queue locked */
+		if (!all && sched_ready_steal_wanted(core)) {
+			spin_unlock(&local->lock);
+			sched_ready_lock_all();
+			all = true;
+		}
 
-			/* Remove from any wait queue */
-			sched_queue_remove(expired);
+		/* Try to get highest priority ready task */
+		task = all ? sched_ready_best(core) : sched_ready_queue_peek(local);
+		if (task) {
 
-			/* Make ready */
-			expired->state = TASK_READY;
-			expired->psp->r0 = (uint32_t)-ETIMEDOUT;
+			assert(task->marker == SCHEDULER_TASK_MARKER && task->state == TASK_READY);
 
-			/* Add to the ready queue */
-			sched_queue_push(&scheduler->ready_queue, expired);
+			/* Running tasks belong to the queue of their core */
+			sched_queue_remove(task);
+			task->state = TASK_RUNNING;
+			task->core = core;
+
+			/* Count the switch while the outgoing task is still ours, losing the core without yielding is a preemption */
+			if (current != 0 && task != current) {
+				if (yielded)
+					++current->voluntary_switches;
+				else
+					++current->preempted_switches;
+			}
 		}
+		current = 0;
 
-		/* Try to get highest priority ready task */
-		task = sched_queue_pop(&scheduler->ready_queue, scheduler_current_core());
-		if (task) {
+		/* Is the stack good? */
+		bool good = task != 0 && scheduler_check_stack(task);
+		if (good)
+			sched_exchange_current(cls, core, task);
+
+		if (all)
+			sched_ready_unlock_all();
+		else
+			spin_unlock(&local->lock);
 
-			assert(task->marker == SCHEDULER_TASK_MARKER);
+		if (good) {
+			scheduler_stack_watermark(task);
+			break;
+		}
 
-			/* Is the stack good? */
-			if (scheduler_check_stack(task))
-				break;
+		/* The rest of the pass needs the scheduler lock */
+		scheduler_spin_lock();
 
-			/* Sadness but evict the task */
+		/* Sadness but evict the task */
+		if (task) {
+			struct sched_ready_queue *owner = sched_ready_lock_task(task);
 			task->state = TASK_TERMINATED;
-			task->psp->r0 = (uint32_t)-EFAULT;
-			sched_queue_remove(task);
-			sched_list_remove(&task->timer_node);
-			sched_list_remove(&task->scheduler_node);
+			task->core = UINT32_MAX;
+			if (owner)
+				spin_unlock(&owner->lock);
+			task->psp->r0 = (uintptr_t)-EFAULT;
+			scheduler_timer_remove(task);
+			sched_task_list_remove(task);
+			scheduler_task_slot_release(task);
 			scheduler_terminated_hook(task);
+			scheduler_spin_unlock();
+			continue;
 		}
 
 		/* If no potential tasks, try to terminate the scheduler */
-		if (!scheduler_is_viable() && cls_datum(scheduler_initial_frame) != 0) {
+		if (!scheduler_is_viable() && cls_datum_at(cls, scheduler_initial_frame) != 0) {
 
 			/* The syscall will return ok */
-			cls_datum(scheduler_initial_frame)->r0 = 0;
+			cls_datum_at(cls, scheduler_initial_frame)->r0 = 0;
+
+			/* The initial frame runs unguarded and without a task */
+			scheduler_stack_guard(0);
+			scheduler_switch_hook(0);
 
 			/* Let the wolves out to play */
 			scheduler_spin_unlock();
 
 			/* This will return to the invoker of scheduler_start */
-			return cls_datum(scheduler_initial_frame);
+			return cls_datum_at(cls, scheduler_initial_frame);
 		}
 
-		/* Call the idle hook if present */
-		scheduler_idle_hook();
-	}
+		/* Sleep until the next timer, collapsing the idle period into a single wake up */
+		scheduler_update_wakeup(cls);
 
-	/* Mark the task as running and return its scheduler frame */
-	assert(task->state == TASK_READY);
-	task->state = TASK_RUNNING;
-	task->core = scheduler_current_core();
+		/* Drop the guard and trace only at the start of an idle period */
+		if (!idle) {
+			scheduler_stack_guard(0);
+			scheduler_switch_hook(0);
+			sched_trace(SCHED_TRACE_IDLE, 0, 0, 0);
+			idle = true;
+		}
 
-	/* Update the slice expires if needed */
-	if (task != last_task || cls_datum(slice_expires) < 0)
-		cls_datum(slice_expires) = scheduler->slice_duration;
+		/* Call the idle hook if present, the time spent there is the idle time of the core */
+		cls_datum_at(cls, idle_start) = sched_timestamp();
+		cls_datum_at(cls, idle_active) = true;
+		scheduler_idle_hook();
+		cls_datum_at(cls, idle_time) += sched_timestamp() - cls_datum_at(cls, idle_start);
+		cls_datum_at(cls, idle_active) = false;
 
-	/* Update the current task */
-	if (sched_set_current(task) != 0)
-		abort();
+		/* The idle hook discards the pended switch of a kick, the queues are peeked again below so drop its bit too */
+		atomic_fetch_and(&scheduler->kicks_pending, ~(1UL << core));
 
-	/* If there are still more ready tasks, kick other cores if need to ensure high priority tasks run */
-	if (!sched_queue_empty(&scheduler->ready_queue)) {
+		scheduler_spin_unlock();
+	}
 
-		/* Check other cores */
-		for (unsigned long core = 0; core < scheduler_num_cores(); ++core) {
+	/* The task is already running and current, guard it and return its scheduler frame */
+	scheduler_stack_guard(task);
+	sched_trace(SCHED_TRACE_SWITCH, task, task->current_priority, (uintptr_t)task);
+	if (task != last_task)
+		++cls_datum_at(cls, switch_count);
 
-			/* Other cores */
-			if (core != scheduler_current_core()) {
+	/* Finish a preempted quantum, otherwise start a new one */
+	unsigned long now = scheduler_get_ticks();
+	if (scheduler_slice_enabled(task))
+		cls_datum_at(cls, slice_expires) = now + (task->slice_remaining != 0 ? task->slice_remaining : task->quantum);
+	task->slice_remaining = 0;
 
-				/* Only kick the other core if there is a higher priority task to run */
-				struct task *core_task = cls_datum_core(core, current_task);
-				if (core_task) {
+	/* Nothing to switch when the same task continues without idling in between */
+	if (task != last_task || idle)
+		scheduler_switch_hook(task);
 
-					/* Well check the priority taking into account core affinity */
-					struct task *cursor;
-					sched_list_for_each_entry(cursor, &scheduler->ready_queue.tasks, queue_node) {
-						if ((cursor->flags & SCHEDULER_CORE_AFFINITY) == 0 || cursor->affinity == core) {
-							if (cursor->current_priority < core_task->current_priority)
-								scheduler_request_switch(core);
-							break;
-						}
-					}
-				}
-			}
-		}
-	}
+	/* Program the next wake up of this core */
+	scheduler_update_wakeup(cls);
 
-	/* Let the wolves out to play */
-	scheduler_spin_unlock();
+	/* Tell the other cores about anything we left behind */
+	sched_ready_kick(core);
 
 	/* Use this frame */
 	return task->psp;
@@ -1017,12 +2297,18 @@ struct task *scheduler_create(void *stack, size_t stack_size, const struct task_
 		return 0;
 	}
 
-	/* Initialize the stack for simple stack consumption measurements */
-	if (descriptor->flags & SCHEDULER_TASK_STACK_CHECK) {
-		unsigned long *pos = stack;
-		unsigned long *end = (void *)(stack + stack_size);
-		while (pos < end)
-			*pos++ = SCHEDULER_STACK_MARKER;
+	/* Pinned tasks need a real core queue */
+	if ((descriptor->flags & SCHEDULER_CORE_AFFINITY) && descriptor->affinity >= SCHEDULER_MAX_CORES) {
+		errno = EINVAL;
+		return 0;
+	}
+
+	/* EDF tasks need a period, a deadline and a budget which fits in both */
+	if (descriptor->flags & SCHEDULER_TASK_EDF) {
+		if ((descriptor->flags & SCHEDULER_PRIMORDIAL_TASK) || descriptor->period == 0 || descriptor->deadline == 0 || descriptor->budget == 0 || descriptor->budget > descriptor->period || descriptor->budget > descriptor->deadline) {
+			errno = EINVAL;
+			return 0;
+		}
 	}
 
 	/* Initialize the task and add to the scheduler task list */
@@ -1033,24 +2319,49 @@ struct task *scheduler_create(void *stack, size_t stack_size, const struct task_
 	sched_list_init(&task->queue_node);
 	sched_list_init(&task->owned_futexes);
 	task->current_queue = 0;
+	task->ready_queue = 0;
+	task->wait_addr = 0;
+	task->wait_flags = 0;
+	task->blocked_on = 0;
+	task->waitv = 0;
+	task->waitv_count = 0;
+	task->slot = SCHEDULER_MAX_TASKS;
 	task->timer_expires = UINT32_MAX;
-	task->base_priority = descriptor->priority;
-	task->current_priority = descriptor->priority;
+	task->base_priority = descriptor->flags & SCHEDULER_TASK_EDF ? SCHEDULER_EDF_PRIORITY : descriptor->priority;
+	task->current_priority = task->base_priority;
+	task->run_time = 0;
+	task->voluntary_switches = 0;
+	task->preempted_switches = 0;
+	task->edf_period = 0;
+	task->edf_relative_deadline = 0;
+	task->edf_release = 0;
+	task->edf_deadline = 0;
+	task->edf_utilisation = 0;
+	task->quantum = descriptor->quantum != 0 ? descriptor->quantum : scheduler->slice_duration;
+	task->slice_remaining = 0;
 	task->exit_handler = descriptor->exit_handler;
 	task->flags = descriptor->flags;
 	task->context = descriptor->context;
 	task->core = UINT32_MAX;
 	task->affinity = descriptor->flags & SCHEDULER_CORE_AFFINITY ? descriptor->affinity : UINT32_MAX;
 
+	/* The density of an EDF task is its budget over the shorter of its deadline and period, rounded up */
+	if (descriptor->flags & SCHEDULER_TASK_EDF) {
+		unsigned long window = descriptor->deadline < descriptor->period ? descriptor->deadline : descriptor->period;
+		task->edf_period = descriptor->period;
+		task->edf_relative_deadline = descriptor->deadline;
+		task->edf_utilisation = ((unsigned long long)descriptor->budget * SCHEDULER_EDF_UTILISATION_SCALE + window - 1) / window;
+	}
+
 	/* Build the scheduler frame to use the PSP and run in privileged mode */
 	if ((descriptor->flags & SCHEDULER_NO_FRAME_INIT) == 0) {
 		task->psp = (struct scheduler_frame *)((((uintptr_t)stack) + stack_size - sizeof(struct scheduler_frame)) & ~7);
 		task->psp->exec_return = 0xfffffffd;
 		task->psp->control = CONTROL_SPSEL_Msk;
-		task->psp->pc = ((uint32_t)descriptor->entry_point & ~0x01UL);
+		task->psp->pc = ((uintptr_t)descriptor->entry_point & ~0x01UL);
 		task->psp->lr = 0;
 		task->psp->psr = xPSR_T_Msk;
-		task->psp->r0 = (uint32_t)task->context;
+		task->psp->r0 = (uintptr_t)task->context;
 	}
 
 #ifdef BUILD_TYPE_DEBUG
@@ -1079,6 +2390,20 @@ struct task *scheduler_create(void *stack, size_t stack_size, const struct task_
 
 		/* And now the stack marker */
 		task->stack_marker = task->tls + scheduler->tls_size;
+
+#if SCHEDULER_MPU_GUARD
+		/* Leave room for an aligned guard between the TLS block and the stack */
+		if (descriptor->flags & SCHEDULER_TASK_STACK_CHECK)
+			task->stack_marker = (void *)ALIGNMENT_ROUND_SIZE((uintptr_t)task->stack_marker, SCHEDULER_MPU_GUARD_SIZE) + SCHEDULER_MPU_GUARD_SIZE;
+#endif
+	}
+
+	/* Only the guard is painted now, the rest is painted a little on each switch */
+	if (descriptor->flags & SCHEDULER_TASK_STACK_CHECK) {
+		task->stack_marker[0] = SCHEDULER_STACK_MARKER;
+		task->stack_marker[1] = SCHEDULER_STACK_MARKER;
+		task->stack_painted = task->stack_marker + 2;
+		task->stack_low = (void *)stack + stack_size;
 	}
 
 	/* Double check the stack marker */
@@ -1087,17 +2412,28 @@ struct task *scheduler_create(void *stack, size_t stack_size, const struct task_
 	/* Handle primordial task specially, very hacky to support threads and pthreads initialization */
 	if (descriptor->flags & SCHEDULER_PRIMORDIAL_TASK) {
 
+		/* Claim a slot, the other core could be running */
+		scheduler_spin_lock();
+		int status = scheduler_task_slot_alloc(task);
+		if (status < 0) {
+			scheduler_spin_unlock();
+			errno = -status;
+			return 0;
+		}
+
 		/* Add the task the scheduler list */
-		sched_list_push(&scheduler->tasks, &task->scheduler_node);
+		sched_task_list_add(task);
+		scheduler_spin_unlock();
 
 		/* Force core affinity */
-		task->flags |= SCHEDULER_CORE_AFFINITY;
+		atomic_fetch_or(&task->flags, SCHEDULER_CORE_AFFINITY);
 		task->affinity = scheduler_current_core();
 
 		/* Mark as running */
 		task->state = TASK_RUNNING;
 		task->core = task->affinity;
 		cls_datum(current_task) = task;
+		scheduler->core_priority[task->core] = task->current_priority;
 
 		/* If the tls pointer was initialized, the forward to the switch hook */
 		if (task->tls != 0)
@@ -1108,13 +2444,19 @@ struct task *scheduler_create(void *stack, size_t stack_size, const struct task_
 	}
 
 	/* Ask scheduler to add the new task */
-	return (struct task *)svc_call1(SCHEDULER_CREATE_SVC, (uint32_t)task);
+	int status = svc_call1(SCHEDULER_CREATE_SVC, (uintptr_t)task);
+	if (status < 0) {
+		errno = -status;
+		return 0;
+	}
+
+	return task;
 }
 
 int scheduler_init(struct scheduler *new_scheduler, size_t tls_size)
 {
-	/* Make sure some memory was provided */
-	if (!new_scheduler) {
+	/* Make sure some memory was provided and we have a run queue for every core */
+	if (!new_scheduler || scheduler_num_cores() > SCHEDULER_MAX_CORES) {
 		errno = EINVAL;
 		return -EINVAL;
 	}
@@ -1126,6 +2468,7 @@ int scheduler_init(struct scheduler *new_scheduler, size_t tls_size)
 	/* TODO NEED A BETTER WAY I.E. Compile time */
 	scheduler_svc_vector[SCHEDULER_SUSPEND_SVC] |= SCHEDULER_FRAME_NEEDED;
 	scheduler_svc_vector[SCHEDULER_WAIT_SVC] |= SCHEDULER_FRAME_NEEDED;
+	scheduler_svc_vector[SCHEDULER_WAITV_SVC] |= SCHEDULER_FRAME_NEEDED;
 
 	/* Initialize the scheduler */
 	memset(new_scheduler, 0, sizeof(struct scheduler));
@@ -1136,18 +2479,50 @@ int scheduler_init(struct scheduler *new_scheduler, size_t tls_size)
 	new_scheduler->timer_expires = UINT32_MAX;
 	new_scheduler->critical = UINT32_MAX;
 	new_scheduler->critical_counter = 0;
-	sched_queue_init(&new_scheduler->ready_queue);
-	sched_list_init(&new_scheduler->timers);
+	for (unsigned long core = 0; core < SCHEDULER_MAX_CORES; ++core) {
+		sched_ready_queue_init(&new_scheduler->ready_queue[core]);
+		new_scheduler->core_priority[core] = SCHEDULER_NUM_TASK_PRIORITIES;
+	}
+	sched_timer_wheel_init(&new_scheduler->timers);
 	sched_list_init(&new_scheduler->tasks);
+	new_scheduler->viable_tasks = 0;
+
+	for (unsigned long bucket = 0; bucket < SCHEDULER_FUTEX_BUCKETS; ++bucket) {
+		new_scheduler->futex_buckets[bucket].lock = 0;
+		new_scheduler->futex_buckets[bucket].waiters = 0;
+		sched_queue_init(&new_scheduler->futex_buckets[bucket].queue);
+		new_scheduler->futex_buckets[bucket].vectored = 0;
+		sched_list_init(&new_scheduler->futex_buckets[bucket].waitv);
+		new_scheduler->futex_buckets[bucket].wake_pending = 0;
+		new_scheduler->futex_buckets[bucket].wake_next = 0;
+	}
+	new_scheduler->deferred_wakes = 0;
+
+#if SCHEDULER_TRACE
+	/* Mark the trace buffers so the decoder can find them in a RAM dump */
+	for (unsigned long core = 0; core < SCHEDULER_MAX_CORES; ++core) {
+		scheduler_trace_buffers[core].marker = SCHEDULER_TRACE_MARKER;
+		scheduler_trace_buffers[core].version = SCHEDULER_TRACE_VERSION;
+		scheduler_trace_buffers[core].core = core;
+		scheduler_trace_buffers[core].records = SCHEDULER_TRACE_RECORDS;
+		scheduler_trace_buffers[core].head = 0;
+	}
+#endif
+
+	/* All task slots are free, lowest slots first */
+	for (unsigned long slot = 0; slot < SCHEDULER_MAX_TASKS; ++slot)
+		new_scheduler->task_slots[slot] = SCHEDULER_MAX_TASKS - 1 - slot;
+	new_scheduler->free_task_slots = SCHEDULER_MAX_TASKS;
 
 	/* Initialize the all core local data */
 	for (unsigned long core = 0; core < scheduler_num_cores(); ++core) {
 		cls_datum_core(core, scheduler_initial_frame) = 0;
 		cls_datum_core(core, current_task) = 0;
-		cls_datum_core(core, slice_expires) = INT32_MAX;
-		cls_datum_core(core, ticks) = 0;
-		memset(cls_datum_core_ptr(core, deferred_wake), 0, sizeof(deferred_wake));
+		cls_datum_core(core, slice_expires) = 0;
+		cls_datum_core(core, ticks) = (uint32_t)SCHEDULER_INITIAL_TICKS;
 	}
+	ticks_epoch = 0;
+	ticks_sequence = 0;
 
 	/* Save a scheduler singleton */
 	scheduler = new_scheduler;
@@ -1290,7 +2665,7 @@ int scheduler_sleep(unsigned long ticks)
 	}
 
 	/* We are timed suspending ourselves */
-	int status = svc_call2(SCHEDULER_SUSPEND_SVC, (uint32_t)scheduler_task(), ticks);
+	int status = svc_call3(SCHEDULER_SUSPEND_SVC, (uintptr_t)scheduler_task(), ticks, false);
 	if (status < 0 && status != -ETIMEDOUT) {
 		errno = -status;
 		return status;
@@ -1300,6 +2675,73 @@ int scheduler_sleep(unsigned long ticks)
 	return 0;
 }
 
+int scheduler_sleep_until(unsigned long long deadline)
+{
+	unsigned long long now = scheduler_get_ticks64();
+
+	/* Already passed, just yield */
+	if (deadline <= now) {
+		scheduler_yield();
+		return 0;
+	}
+
+	/* The wheel resolves half the tick range, sleep in steps towards a further deadline */
+	while (now < deadline) {
+		unsigned long long expires = deadline - now > DELAY_MAX ? now + DELAY_MAX : deadline;
+		int status = svc_call3(SCHEDULER_SUSPEND_SVC, (uintptr_t)scheduler_task(), (unsigned long)expires, true);
+		if (status < 0 && status != -ETIMEDOUT) {
+			errno = -status;
+			return status;
+		}
+		now = scheduler_get_ticks64();
+	}
+
+	/* All good */
+	return 0;
+}
+
+int scheduler_edf_wait_period(void)
+{
+	struct task *task = scheduler_task();
+
+	/* Only for EDF tasks */
+	if (!task || (task->flags & SCHEDULER_TASK_EDF) == 0) {
+		errno = EINVAL;
+		return -EINVAL;
+	}
+
+	/* Did the job finish late? */
+	unsigned long now = scheduler_get_ticks();
+	bool missed = (int32_t)(now - task->edf_deadline) > 0;
+
+	/* Only the task itself changes its release, the ready queues never hold a running task */
+	task->edf_release += task->edf_period;
+	if ((int32_t)(now - task->edf_release) >= 0) {
+
+		/* Overran by whole periods, skip the missed releases and start the next job now */
+		task->edf_release += ((now - task->edf_release) / task->edf_period) * task->edf_period;
+		task->edf_deadline = task->edf_release + task->edf_relative_deadline;
+
+	} else {
+
+		/* Sleep until the next release */
+		task->edf_deadline = task->edf_release + task->edf_relative_deadline;
+		int status = svc_call3(SCHEDULER_SUSPEND_SVC, (uintptr_t)task, task->edf_release, true);
+		if (status < 0 && status != -ETIMEDOUT) {
+			errno = -status;
+			return status;
+		}
+	}
+
+	/* Report a missed deadline */
+	if (missed) {
+		errno = ETIMEDOUT;
+		return -ETIMEDOUT;
+	}
+
+	return 0;
+}
+
 int scheduler_suspend(struct task *task)
 {
 	/* Are we suspending ourselves? */
@@ -1312,7 +2754,7 @@ int scheduler_suspend(struct task *task)
 	}
 
 	/* Suspend it */
-	int status = svc_call2(SCHEDULER_SUSPEND_SVC, (uint32_t)task, SCHEDULER_WAIT_FOREVER);
+	int status = svc_call3(SCHEDULER_SUSPEND_SVC, (uintptr_t)task, SCHEDULER_WAIT_FOREVER, false);
 	if (status < 0) {
 		errno = -status;
 		return status;
@@ -1327,7 +2769,7 @@ int scheduler_resume(struct task *task)
 	assert(task != 0);
 
 	/* Make the task ready to run */
-	int status = svc_call1(SCHEDULER_RESUME_SVC, (uint32_t)task);
+	int status = svc_call1(SCHEDULER_RESUME_SVC, (uintptr_t)task);
 	if (status < 0)
 		errno = -status;
 
@@ -1347,7 +2789,7 @@ int scheduler_terminate(struct task *task)
 	}
 
 	/* Forward */
-	int status = svc_call1(SCHEDULER_TERMINATE_SVC, (uint32_t)task);
+	int status = svc_call1(SCHEDULER_TERMINATE_SVC, (uintptr_t)task);
 	if (status < 0) {
 		errno = -status;
 		return status;
@@ -1363,7 +2805,6 @@ void scheduler_futex_init(struct futex *futex, long *value, unsigned long flags)
 	futex->marker = SCHEDULER_FUTEX_MARKER;
 	futex->value = value;
 	futex->flags = flags;
-	sched_queue_init(&futex->waiters);
 	sched_list_init(&futex->owned);
 }
 
@@ -1371,7 +2812,26 @@ int scheduler_futex_wait(struct futex *futex, long value, unsigned long ticks)
 {
 	assert(futex != 0 && futex->marker == SCHEDULER_FUTEX_MARKER);
 
-	int status = svc_call3(SCHEDULER_WAIT_SVC, (uint32_t)futex, value, ticks);
+	int status = svc_call4(SCHEDULER_WAIT_SVC, (uintptr_t)futex, value, ticks, false);
+	if (status < 0)
+		errno = -status;
+
+	return status;
+}
+
+int scheduler_futex_wait_until(struct futex *futex, long value, unsigned long long deadline)
+{
+	assert(futex != 0 && futex->marker == SCHEDULER_FUTEX_MARKER);
+
+	int status;
+	unsigned long long now = scheduler_get_ticks64();
+
+	/* The wheel resolves half the tick range, a further deadline times out early and waits again */
+	do {
+		unsigned long long expires = deadline > now && deadline - now > DELAY_MAX ? now + DELAY_MAX : deadline;
+		status = svc_call4(SCHEDULER_WAIT_SVC, (uintptr_t)futex, value, (unsigned long)expires, true);
+	} while (status == -ETIMEDOUT && (now = scheduler_get_ticks64()) < deadline);
+
 	if (status < 0)
 		errno = -status;
 
@@ -1379,41 +2839,164 @@ int scheduler_futex_wait(struct futex *futex, long value, unsigned long ticks)
 }
 
 int scheduler_futex_wake(struct futex *futex, bool all)
+{
+	return scheduler_futex_wake_n(futex, all ? ULONG_MAX : 1);
+}
+
+int scheduler_futex_wake_n(struct futex *futex, unsigned long count)
 {
 	assert(futex != 0 && futex->marker == SCHEDULER_FUTEX_MARKER);
 
+	/* Nothing asked for */
+	if (count == 0)
+		return 0;
+
+	/* Nobody is waiting in the bucket, owner tracking futexes always need the service to hand over the value */
+	if ((futex->flags & SCHEDULER_FUTEX_OWNER_TRACKING) == 0 && atomic_load(&sched_futex_bucket(futex->value)->waiters) == 0)
+		return 0;
+
 	/* Do it the hard way? */
 	if (is_interrupt_context()) {
 
-		/* Make the contention tracking and priority inheritance is disabled */
-		if ((futex->flags & (SCHEDULER_FUTEX_PI | SCHEDULER_FUTEX_OWNER_TRACKING)) != 0) {
+		/* Make sure contention tracking and priority inheritance are disabled */
+		if (futex->flags != 0) {
 			errno = EINVAL;
 			return -EINVAL;
 		}
 
-		/* Find an empty slot */
-		unsigned long expected = 0;
-		unsigned long wakeup = (unsigned long)futex | all;
-		for (int i = 0; i < SCHEDULER_MAX_DEFERED_WAKE; ++i) {
-			/* The second clause protects from multiple wakeups against the same futex */
-			if (atomic_compare_exchange_strong(&cls_datum(deferred_wake)[i], &expected, wakeup)) {
-				++cls_datum(given_wake_counter);
-				scheduler_request_switch(scheduler_current_core());
-				return 0;
-			} else if (expected == wakeup)
+		/* Merge into the pending bucket wake, a second address in the same bucket degrades to waking the whole bucket, more than one waiter to all of them */
+		struct sched_futex_bucket *bucket = sched_futex_bucket(futex->value);
+		unsigned long wakeup = (unsigned long)futex->value | (count > 1 ? SCHEDULER_WAKE_ALL : 0);
+		unsigned long pending = atomic_load(&bucket->wake_pending);
+		unsigned long merged;
+		do {
+			if (pending == 0)
+				merged = wakeup;
+			else if ((pending & ~SCHEDULER_WAKE_ALL) == (unsigned long)futex->value)
+				merged = pending | wakeup;
+			else
+				merged = SCHEDULER_WAKE_BUCKET;
+
+			/* Already pending */
+			if (merged == pending)
 				return 0;
 
-			/* Get ready to try the next slot */
-			expected = 0;
+		} while (!atomic_compare_exchange_weak(&bucket->wake_pending, &pending, merged));
+
+		/* Only the first pending wake links the bucket onto the deferred wake list */
+		if (pending == 0) {
+			unsigned long head = atomic_load(&scheduler->deferred_wakes);
+			do {
+				bucket->wake_next = head;
+			} while (!atomic_compare_exchange_weak(&scheduler->deferred_wakes, &head, (unsigned long)bucket));
 		}
 
-		/* Very bad, resource exhausted */
-		errno = ENOSPC;
-		return -ENOSPC;
+		/* Let PendSV drain the list */
+		sched_trace(SCHED_TRACE_DEFERRED_WAKE, 0, count > 1, (uintptr_t)futex->value);
+		scheduler_request_switch(scheduler_current_core());
+		return 0;
 	}
 
 	/* Send to the wake service */
-	int status = svc_call2(SCHEDULER_WAKE_SVC, (uint32_t)futex, all);
+	int status = svc_call2(SCHEDULER_WAKE_SVC, (uintptr_t)futex, count);
+	if (status < 0)
+		errno = -status;
+
+	return status;
+}
+
+int scheduler_futex_wait_addr(long *addr, long value, unsigned long ticks)
+{
+	assert(addr != 0);
+
+	/* Plain words get a transient futex, all the waiter state lives in the hash buckets */
+	struct futex futex;
+	scheduler_futex_init(&futex, addr, 0);
+	return scheduler_futex_wait(&futex, value, ticks);
+}
+
+int scheduler_futex_waitv(struct futex_waitv *waiters, unsigned long count, unsigned long ticks)
+{
+	assert(waiters != 0);
+
+	/* Bounded, the service checks every value holding the scheduler lock */
+	if (count == 0 || count > SCHEDULER_FUTEX_WAITV_MAX) {
+		errno = EINVAL;
+		return -EINVAL;
+	}
+
+	/* Returns the index of the address which fired */
+	int status = svc_call4(SCHEDULER_WAITV_SVC, (uintptr_t)waiters, count, ticks, false);
+	if (status < 0)
+		errno = -status;
+
+	return status;
+}
+
+int scheduler_futex_waitv_until(struct futex_waitv *waiters, unsigned long count, unsigned long long deadline)
+{
+	assert(waiters != 0);
+
+	/* Bounded, the service checks every value holding the scheduler lock */
+	if (count == 0 || count > SCHEDULER_FUTEX_WAITV_MAX) {
+		errno = EINVAL;
+		return -EINVAL;
+	}
+
+	int status;
+	unsigned long long now = scheduler_get_ticks64();
+
+	/* The wheel resolves half the tick range, a further deadline times out early and waits again */
+	do {
+		unsigned long long expires = deadline > now && deadline - now > DELAY_MAX ? now + DELAY_MAX : deadline;
+		status = svc_call4(SCHEDULER_WAITV_SVC, (uintptr_t)waiters, count, (unsigned long)expires, true);
+	} while (status == -ETIMEDOUT && (now = scheduler_get_ticks64()) < deadline);
+
+	if (status < 0)
+		errno = -status;
+
+	return status;
+}
+
+int scheduler_futex_wait_addr_until(long *addr, long value, unsigned long long deadline)
+{
+	assert(addr != 0);
+
+	/* Plain words get a transient futex, all the waiter state lives in the hash buckets */
+	struct futex futex;
+	scheduler_futex_init(&futex, addr, 0);
+	return scheduler_futex_wait_until(&futex, value, deadline);
+}
+
+int scheduler_futex_wake_addr(long *addr, bool all)
+{
+	return scheduler_futex_wake_addr_n(addr, all ? ULONG_MAX : 1);
+}
+
+int scheduler_futex_wake_addr_n(long *addr, unsigned long count)
+{
+	assert(addr != 0);
+
+	struct futex futex;
+	scheduler_futex_init(&futex, addr, 0);
+	return scheduler_futex_wake_n(&futex, count);
+}
+
+int scheduler_futex_requeue(long *addr, long value, struct futex *target)
+{
+	assert(addr != 0 && target != 0 && target->marker == SCHEDULER_FUTEX_MARKER);
+
+	/* Nobody to wake or move */
+	if (atomic_load(&sched_futex_bucket(addr)->waiters) == 0)
+		return 0;
+
+	/* Only thread mode can take the service, interrupts and exit handlers fall back to a plain wake */
+	if (is_interrupt_context()) {
+		errno = EPERM;
+		return -EPERM;
+	}
+
+	int status = svc_call3(SCHEDULER_REQUEUE_SVC, (uintptr_t)addr, value, (uintptr_t)target);
 	if (status < 0)
 		errno = -status;
 
@@ -1432,8 +3015,14 @@ int scheduler_set_priority(struct task *task, unsigned long priority)
 	if (!task)
 		task = scheduler_task();
 
+	/* EDF tasks live in the EDF band */
+	if (task->flags & SCHEDULER_TASK_EDF) {
+		errno = EINVAL;
+		return -EINVAL;
+	}
+
 	/* Forward to the service handler */
-	return svc_call2(SCHEDULER_PRIORITY_SVC, (uint32_t)task, priority);
+	return svc_call2(SCHEDULER_PRIORITY_SVC, (uintptr_t)task, priority);
 }
 
 unsigned long scheduler_get_priority(struct task *task)
@@ -1445,6 +3034,20 @@ unsigned long scheduler_get_priority(struct task *task)
 	return task->current_priority;
 }
 
+int scheduler_set_quantum(struct task *task, unsigned long quantum)
+{
+	/* Use the current task if needed */
+	if (!task)
+		task = scheduler_task();
+
+	assert(task != 0 && task->marker == SCHEDULER_TASK_MARKER);
+
+	/* Only read by the switch, a running task finishes its current slice first */
+	task->quantum = quantum != 0 ? quantum : scheduler->slice_duration;
+
+	return 0;
+}
+
 void scheduler_set_flags(struct task *task, unsigned long mask)
 {
 	/* Use the current task if needed */
@@ -1453,7 +3056,17 @@ void scheduler_set_flags(struct task *task, unsigned long mask)
 
 	assert(task != 0 && task->marker == SCHEDULER_TASK_MARKER);
 
-	task->flags |= mask;
+	/* Flags are always changed atomically, only the viable count needs the lock */
+	if ((mask & SCHEDULER_IGNORE_VIABLE) == 0) {
+		atomic_fetch_or(&task->flags, mask);
+		return;
+	}
+
+	/* A live task stops counting */
+	unsigned int state = scheduler_spin_lock_irqsave();
+	if ((atomic_fetch_or(&task->flags, mask) & SCHEDULER_IGNORE_VIABLE) == 0 && sched_list_is_linked(&task->scheduler_node))
+		--scheduler->viable_tasks;
+	scheduler_spin_unlock_irqrestore(state);
 }
 
 void scheduler_clear_flags(struct task *task, unsigned long mask)
@@ -1464,7 +3077,17 @@ void scheduler_clear_flags(struct task *task, unsigned long mask)
 
 	assert(task != 0 && task->marker == SCHEDULER_TASK_MARKER);
 
-	task->flags &= ~mask;
+	/* Flags are always changed atomically, only the viable count needs the lock */
+	if ((mask & SCHEDULER_IGNORE_VIABLE) == 0) {
+		atomic_fetch_and(&task->flags, ~mask);
+		return;
+	}
+
+	/* A live task counts again */
+	unsigned int state = scheduler_spin_lock_irqsave();
+	if ((atomic_fetch_and(&task->flags, ~mask) & SCHEDULER_IGNORE_VIABLE) != 0 && sched_list_is_linked(&task->scheduler_node))
+		++scheduler->viable_tasks;
+	scheduler_spin_unlock_irqrestore(state);
 }
 
 unsigned long scheduler_get_flags(struct task *task)
@@ -1498,3 +3121,174 @@ enum task_state scheduler_get_state(struct task *task)
 
 	return task->state;
 }
+
+int scheduler_get_task_stats(struct task *task, struct task_stats *stats)
+{
+	/* Use the current task if needed */
+	if (!task)
+		task = scheduler_task();
+
+	/* The counters are updated under the scheduler lock, which can not be taken from an interrupt */
+	if (!stats || is_interrupt_context()) {
+		errno = EINVAL;
+		return -EINVAL;
+	}
+
+	unsigned int state = scheduler_spin_lock_irqsave();
+
+	/* Make sure the task is alive */
+	int status = scheduler_task_alive(task);
+	if (status == 0) {
+
+		/* A running task has not been charged for the current run yet */
+		stats->run_time = task->run_time;
+		if (task->state == TASK_RUNNING && task->core < SCHEDULER_MAX_CORES)
+			stats->run_time += sched_timestamp() - cls_datum_core(task->core, switch_timestamp);
+		stats->voluntary_switches = task->voluntary_switches;
+		stats->preempted_switches = task->preempted_switches;
+	}
+
+	scheduler_spin_unlock_irqrestore(state);
+
+	if (status < 0)
+		errno = -status;
+
+	return status;
+}
+
+int scheduler_get_core_stats(unsigned long core, struct core_stats *stats)
+{
+	/* Range check the core, the lock can not be taken from an interrupt */
+	if (!stats || core >= scheduler_num_cores() || is_interrupt_context()) {
+		errno = EINVAL;
+		return -EINVAL;
+	}
+
+	unsigned int state = scheduler_spin_lock_irqsave();
+
+	/* An idle core has not been charged for the current idle period yet */
+	stats->timestamp = sched_timestamp();
+	stats->idle_time = cls_datum_core(core, idle_time);
+	if (cls_datum_core(core, idle_active))
+		stats->idle_time += stats->timestamp - cls_datum_core(core, idle_start);
+	stats->switches = cls_datum_core(core, switch_count);
+
+	scheduler_spin_unlock_irqrestore(state);
+
+	return 0;
+}
+
+size_t scheduler_get_stack_space(struct task *task)
+{
+	/* Use the current task if needed */
+	if (!task)
+		task = scheduler_task();
+
+	assert(task != 0 && task->marker == SCHEDULER_TASK_MARKER);
+
+	/* Only checked stacks have a watermark */
+	if ((task->flags & SCHEDULER_TASK_STACK_CHECK) == 0)
+		return 0;
+
+	/* The cached low water mark is refreshed on every switch, the running task can check its own stack pointer */
+	unsigned long *low = task->stack_low;
+	if (task == scheduler_task() && !is_interrupt_context() && (unsigned long *)__get_PSP() < low)
+		low = (unsigned long *)__get_PSP();
+
+	return low > task->stack_marker ? (low - task->stack_marker) * sizeof(unsigned long) : 0;
+}
+
+size_t scheduler_task_pool_size(const struct task_pool_descriptor *classes, unsigned long num_classes)
+{
+	assert(classes != 0);
+
+	/* Every block is rounded to keep the stacks 8 byte aligned */
+	size_t size = 0;
+	for (unsigned long i = 0; i < num_classes; ++i)
+		size += ALIGNMENT_ROUND_SIZE(classes[i].block_size, 8) * classes[i].count;
+
+	return size;
+}
+
+int scheduler_task_pool_init(struct task_pool *pool, void *memory, size_t size, const struct task_pool_descriptor *classes, unsigned long num_classes)
+{
+	/* The classes must fit, be in increasing size and the memory must be large enough and aligned for a stack */
+	if (!pool || !memory || !classes || num_classes == 0 || num_classes > SCHEDULER_TASK_POOL_CLASSES || ((uintptr_t)memory & 7) != 0 || size < scheduler_task_pool_size(classes, num_classes)) {
+		errno = EINVAL;
+		return -EINVAL;
+	}
+	for (unsigned long i = 0; i < num_classes; ++i) {
+		if (classes[i].block_size < sizeof(struct task) || (i > 0 && classes[i].block_size <= classes[i - 1].block_size)) {
+			errno = EINVAL;
+			return -EINVAL;
+		}
+	}
+
+	/* Carve the memory into the classes and thread the free lists */
+	pool->lock = 0;
+	pool->num_classes = num_classes;
+	void *block = memory;
+	for (unsigned long i = 0; i < num_classes; ++i) {
+		struct task_pool_class *class = &pool->classes[i];
+		class->block_size = ALIGNMENT_ROUND_SIZE(classes[i].block_size, 8);
+		class->count = classes[i].count;
+		class->available = classes[i].count;
+		class->blocks = block;
+		class->free = 0;
+		for (unsigned long j = 0; j < class->count; ++j) {
+			*(void **)block = class->free;
+			class->free = block;
+			block += class->block_size;
+		}
+	}
+	pool->marker = SCHEDULER_TASK_POOL_MARKER;
+
+	return 0;
+}
+
+void *scheduler_task_pool_alloc(struct task_pool *pool, size_t size)
+{
+	assert(pool != 0 && pool->marker == SCHEDULER_TASK_POOL_MARKER);
+
+	unsigned int state = spin_lock_irqsave(&pool->lock);
+
+	/* Take from the smallest class which fits and still has a block */
+	void *block = 0;
+	for (unsigned long i = 0; i < pool->num_classes; ++i) {
+		struct task_pool_class *class = &pool->classes[i];
+		if (class->block_size >= size && class->free != 0) {
+			block = class->free;
+			class->free = *(void **)block;
+			--class->available;
+			break;
+		}
+	}
+
+	spin_unlock_irqrestore(&pool->lock, state);
+
+	if (!block)
+		errno = ENOMEM;
+
+	return block;
+}
+
+void scheduler_task_pool_release(struct task_pool *pool, void *block)
+{
+	assert(pool != 0 && pool->marker == SCHEDULER_TASK_POOL_MARKER && block != 0);
+
+	unsigned int state = spin_lock_irqsave(&pool->lock);
+
+	/* Find the owning class from the block address */
+	for (unsigned long i = 0; i < pool->num_classes; ++i) {
+		struct task_pool_class *class = &pool->classes[i];
+		if (block >= class->blocks && block < class->blocks + class->block_size * class->count) {
+			assert(((uintptr_t)(block - class->blocks) % class->block_size) == 0);
+			*(void **)block = class->free;
+			class->free = block;
+			++class->available;
+			break;
+		}
+	}
+
+	spin_unlock_irqrestore(&pool->lock, state);
+}
@@ -22,6 +22,38 @@ struct svc_frame
 	uint32_t r3;
 };
 
+#if PICO_TOOLKIT_HOST
+
+/* The host port has no SVC instruction, the service call runs the handler on the calling stack */
+int host_svc_call(uint8_t code, uintptr_t arg0, uintptr_t arg1, uintptr_t arg2, uintptr_t arg3);
+
+static inline __always_inline int svc_call0(const uint8_t code)
+{
+	return host_svc_call(code, 0, 0, 0, 0);
+}
+
+static inline __always_inline int svc_call1(const uint8_t code, uintptr_t arg0)
+{
+	return host_svc_call(code, arg0, 0, 0, 0);
+}
+
+static inline __always_inline int svc_call2(const uint8_t code, uintptr_t arg0, uintptr_t arg1)
+{
+	return host_svc_call(code, arg0, arg1, 0, 0);
+}
+
+static inline __always_inline int svc_call3(const uint8_t code, uintptr_t arg0, uintptr_t arg1, uintptr_t arg2)
+{
+	return host_svc_call(code, arg0, arg1, arg2, 0);
+}
+
+static inline __always_inline int svc_call4(const uint8_t code, uintptr_t arg0, uintptr_t arg1, uintptr_t arg2, uintptr_t arg3)
+{
+	return host_svc_call(code, arg0, arg1, arg2, arg3);
+}
+
+#else
+
 static inline __always_inline int svc_call0(const uint8_t code)
 {
 	int result;
@@ -36,7 +68,7 @@ static inline __always_inline int svc_call0(const uint8_t code)
 	return result;
 }
 
-static inline __always_inline int svc_call1(const uint8_t code, uint32_t arg0)
+static inline __always_inline int svc_call1(const uint8_t code, uintptr_t arg0)
 {
 	int result;
 
@@ -51,7 +83,7 @@ static inline __always_inline int svc_call1(const uint8_t code, uint32_t arg0)
 	return result;
 }
 
-static inline __always_inline int svc_call2(const uint8_t code, uint32_t arg0, uint32_t arg1)
+static inline __always_inline int svc_call2(const uint8_t code, uintptr_t arg0, uintptr_t arg1)
 {
 	int result;
 
@@ -67,7 +99,7 @@ static inline __always_inline int svc_call2(const uint8_t code, uint32_t arg0, u
 	return result;
 }
 
-static inline __always_inline int svc_call3(const uint8_t code, uint32_t arg0, uint32_t arg1, uint32_t arg2)
+static inline __always_inline int svc_call3(const uint8_t code, uintptr_t arg0, uintptr_t arg1, uintptr_t arg2)
 {
 	int result;
 
@@ -84,7 +116,7 @@ static inline __always_inline int svc_call3(const uint8_t code, uint32_t arg0, u
 	return result;
 }
 
-static inline __always_inline int svc_call4(const uint8_t code, uint32_t arg0, uint32_t arg1, uint32_t arg2, uint32_t arg3)
+static inline __always_inline int svc_call4(const uint8_t code, uintptr_t arg0, uintptr_t arg1, uintptr_t arg2, uintptr_t arg3)
 {
 	int result;
 
@@ -103,3 +135,5 @@ static inline __always_inline int svc_call4(const uint8_t code, uint32_t arg0, u
 }
 
 #endif
+
+#endif
@@ -0,0 +1,165 @@
+#!/usr/bin/env python3
+#
+# Copyright (C) 2024 Stephen Street
+#
+# This Source Code Form is subject to the terms of the Mozilla Public
+# License, v. 2.0. If a copy of the MPL was not distributed with this
+# file, You can obtain one at http://mozilla.org/MPL/2.0/.
+#
+# Decode the scheduler trace buffers found in a RAM dump into Chrome trace
+# event JSON, which can be loaded by Perfetto (ui.perfetto.dev) or
+# chrome://tracing. The buffer layout must match
+# include/pico/toolkit/scheduler-trace.h.
+#
+# Example, with a RAM dump taken by openocd:
+#
+#   openocd ... -c "init; halt; dump_image ram.bin 0x20000000 0x42000; exit"
+#   scheduler-trace.py ram.bin -o trace.json
+#
+
+import argparse
+import json
+import struct
+import sys
+
+TRACE_MARKER = 0x45435254
+TRACE_VERSION = 1
+TRACE_NO_TASK = 0xffff
+
+HEADER = struct.Struct('<IHHII')
+RECORD = struct.Struct('<IBBHI')
+
+SWITCH = 1
+IDLE = 2
+WAIT = 3
+WAKE = 4
+TIMER_EXPIRE = 5
+TICK = 6
+DEFERRED_WAKE = 7
+
+EVENT_NAMES = {
+	WAIT: 'wait',
+	WAKE: 'wake',
+	TIMER_EXPIRE: 'timer expire',
+	TICK: 'tick',
+	DEFERRED_WAKE: 'deferred wake',
+}
+
+
+def find_buffers(dump, base):
+	"""Scan the dump for word aligned trace buffer headers"""
+	buffers = []
+	offset = dump.find(struct.pack('<I', TRACE_MARKER))
+	while offset >= 0:
+		if offset % 4 == 0 and offset + HEADER.size <= len(dump):
+			marker, version, core, records, head = HEADER.unpack_from(dump, offset)
+			end = offset + HEADER.size + records * RECORD.size
+			if version == TRACE_VERSION and core < 8 and records != 0 and records & (records - 1) == 0 and end <= len(dump):
+				buffers.append((base + offset, core, records, head, offset + HEADER.size))
+		offset = dump.find(struct.pack('<I', TRACE_MARKER), offset + 1)
+	return buffers
+
+
+def read_records(dump, records, head, start):
+	"""Return the valid records of a buffer, oldest first"""
+	count = min(head, records)
+	first = head - count
+	result = []
+	for index in range(first, head):
+		result.append(RECORD.unpack_from(dump, start + (index % records) * RECORD.size))
+	return result
+
+
+def unwrap(records):
+	"""Extend the 32 bit microsecond timestamps, the records of a core are in time order"""
+	result = []
+	upper = 0
+	last = None
+	for timestamp, event, info, slot, arg in records:
+		if last is not None and timestamp < last:
+			upper += 1 << 32
+		last = timestamp
+		result.append((upper + timestamp, event, info, slot, arg))
+	return result
+
+
+def task_name(slot):
+	return 'task %d' % slot if slot != TRACE_NO_TASK else 'none'
+
+
+def decode(dump, base, ticks):
+	events = []
+	buffers = find_buffers(dump, base)
+	if not buffers:
+		raise ValueError('no scheduler trace buffers found')
+
+	for address, core, records, head, start in buffers:
+
+		events.append({'name': 'thread_name', 'ph': 'M', 'pid': 0, 'tid': core, 'args': {'name': 'core %d' % core}})
+		if head > records:
+			print('core %d: %d records lost to wrap around' % (core, head - records), file=sys.stderr)
+
+		# Running tasks and idle periods are slices on the core track
+		running = None
+		timestamp = 0
+		for timestamp, event, info, slot, arg in unwrap(read_records(dump, records, head, start)):
+
+			if event in (SWITCH, IDLE):
+				if running is not None:
+					events.append({'name': running, 'ph': 'E', 'pid': 0, 'tid': core, 'ts': timestamp})
+				running = task_name(slot) if event == SWITCH else 'idle'
+				args = {'task': '0x%08x' % arg, 'priority': info} if event == SWITCH else {}
+				events.append({'name': running, 'ph': 'B', 'pid': 0, 'tid': core, 'ts': timestamp, 'args': args})
+
+			elif event in EVENT_NAMES:
+				if event == TICK and not ticks:
+					continue
+				args = {'task': task_name(slot)}
+				if event in (WAIT, WAKE, DEFERRED_WAKE):
+					args['futex'] = '0x%08x' % arg
+				else:
+					args['tick'] = arg
+				if event == WAIT:
+					args['blocked'] = bool(info)
+				if event == DEFERRED_WAKE:
+					args['all'] = bool(info)
+				events.append({'name': EVENT_NAMES[event], 'ph': 'i', 's': 't', 'pid': 0, 'tid': core, 'ts': timestamp, 'args': args})
+
+			else:
+				print('core %d: unknown event %d' % (core, event), file=sys.stderr)
+
+		# Close the last slice
+		if running is not None:
+			events.append({'name': running, 'ph': 'E', 'pid': 0, 'tid': core, 'ts': timestamp})
+
+	events.insert(0, {'name': 'process_name', 'ph': 'M', 'pid': 0, 'args': {'name': 'pico-scheduler'}})
+	return {'traceEvents': events, 'displayTimeUnit': 'ns'}
+
+
+def main():
+	parser = argparse.ArgumentParser(description='Convert scheduler trace buffers in a RAM dump to Perfetto/Chrome trace JSON')
+	parser.add_argument('dump', help='raw RAM dump')
+	parser.add_argument('-b', '--base', type=lambda value: int(value, 0), default=0x20000000, help='address of the first byte of the dump')
+	parser.add_argument('-o', '--output', help='output file, default is stdout')
+	parser.add_argument('-t', '--ticks', action='store_true', help='include the tick events')
+	args = parser.parse_args()
+
+	with open(args.dump, 'rb') as file:
+		dump = file.read()
+
+	try:
+		trace = decode(dump, args.base, args.ticks)
+	except ValueError as error:
+		print('%s: %s' % (args.dump, error), file=sys.stderr)
+		return 1
+
+	output = open(args.output, 'w') if args.output else sys.stdout
+	json.dump(trace, output, indent=1)
+	if args.output:
+		output.close()
+
+	return 0
+
+
+if __name__ == '__main__':
+	sys.exit(main())
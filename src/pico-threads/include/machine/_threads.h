@@ -31,7 +31,7 @@
 
 #define ONCE_FLAG_INIT 0
 
-typedef atomic_int once_flag;
+typedef atomic_long once_flag;
 typedef uintptr_t thrd_t;
 typedef size_t tss_t;
 
@@ -51,7 +51,6 @@ typedef struct cnd
 {
 	struct mtx *mutex;
 	unsigned long sequence;
-	struct futex futex;
 } cnd_t;
 
 struct tss
@@ -70,6 +69,7 @@ struct thrd
 	thrd_t joiner;
 	struct cnd joiners;
 	struct linked_list thrd_node;
+	struct task_pool *pool;
 	void *tss[__THRD_KEYS_MAX];
 	unsigned long marker;
 	char stack[] __attribute__((aligned(8)));
@@ -81,10 +81,13 @@ typedef struct thrd_attr
 	unsigned long priority;
 	unsigned long affinity;
 	size_t stack_size;
+	struct task_pool *pool;
 } thrd_attr_t;
 
 void _thdr_attr_init(thrd_attr_t *attr, unsigned long flags, unsigned long priority, size_t stack_size, unsigned long affinity);
 int	_thrd_create(thrd_t *thrd, int (*func)(void *), void *arg, thrd_attr_t *attr);
 int _thrd_sleep(unsigned long msec);
+int _cnd_signal_n(cnd_t *cnd, unsigned long count);
+int _cnd_wait_any(cnd_t *const cnds[], unsigned long count, mtx_t *mtx, const struct timespec *tm, unsigned long *index);
 
 #endif
@@ -13,6 +13,7 @@
 
 #include <errno.h>
 #include <assert.h>
+#include <limits.h>
 #include <stdio.h>
 #include <string.h>
 #include <threads.h>
@@ -58,24 +59,35 @@ __weak void _thrd_release(void *ptr)
 	free(ptr);
 }
 
+static unsigned long long _timespec_to_ticks(const struct timespec *tm)
+{
+	/* Ticks and msecs are treated the same */
+	return ((unsigned long long)tm->tv_sec * 1000) + (tm->tv_nsec / 1000000);
+}
+
+static void _thrd_free(struct thrd *thread)
+{
+	/* Pooled threads go back to their pool */
+	if (thread->pool)
+		scheduler_task_pool_release(thread->pool, thread);
+	else
+		_thrd_release(thread);
+}
+
 void call_once(once_flag *flag, void (*func)(void))
 {
 	/* All ready done */
 	if (atomic_load(flag) == 2)
 		return;
 
-	/* Setup a futex to wait on */
-	struct futex futex;
-	scheduler_futex_init(&futex, (long *)flag, 0);
-
 	/* Try to claim the initializer */
-	int expected = 0;
+	long expected = 0;
 	if (!atomic_compare_exchange_strong(flag, &expected, 1)) {
 
 		/* Wait on the futex */
 		expected = 2;
 		while (!atomic_compare_exchange_strong(flag, &expected, 2)) {
-			scheduler_futex_wait(&futex, expected, SCHEDULER_WAIT_FOREVER);
+			scheduler_futex_wait_addr((long *)flag, expected, SCHEDULER_WAIT_FOREVER);
 			expected = 2;
 		}
 
@@ -90,7 +102,7 @@ void call_once(once_flag *flag, void (*func)(void))
 	atomic_store(flag, 2);
 
 	/* Wake any waiters */
-	scheduler_futex_wake(&futex, true);
+	scheduler_futex_wake_addr((long *)flag, true);
 }
 
 void cnd_destroy(cnd_t *cnd)
@@ -104,17 +116,16 @@ int cnd_init(cnd_t *cnd)
 	/* Initialize */
 	cnd->mutex = 0;
 	cnd->sequence = 0;
-	scheduler_futex_init(&cnd->futex, (long *)&cnd->sequence, 0);
 
 	/* Great */
 	return thrd_success;
 }
 
-static int _cnd_wait(cnd_t *cnd, mtx_t *mtx, unsigned long msec)
+static int _cnd_wait(cnd_t *cnd, mtx_t *mtx, unsigned long long deadline)
 {
 	assert(cnd != 0 && mtx != 0);
 
-	int sequence = cnd->sequence;
+	unsigned long sequence = cnd->sequence;
 	struct mtx *expected = 0;
 
 	if (cnd->mutex != mtx) {
@@ -125,9 +136,15 @@ static int _cnd_wait(cnd_t *cnd, mtx_t *mtx, unsigned long msec)
 		}
 	}
 
+	/* Timed waits use the absolute deadline directly, nothing is lost converting it to a delay */
 	mtx_unlock(cnd->mutex);
-	int status = scheduler_futex_wait(&cnd->futex, sequence, msec);
-	mtx_lock(cnd->mutex);
+	int status = deadline == ULLONG_MAX ? scheduler_futex_wait_addr((long *)&cnd->sequence, sequence, SCHEDULER_WAIT_FOREVER) : scheduler_futex_wait_addr_until((long *)&cnd->sequence, sequence, deadline);
+
+	/* A broadcast may have requeued us onto the mutex, in which case the unlock already handed it over */
+	if ((long)(cnd->mutex->value & ~SCHEDULER_FUTEX_CONTENTION_TRACKING) != (long)scheduler_task())
+		mtx_lock(cnd->mutex);
+	else if (cnd->mutex->type & mtx_recursive)
+		cnd->mutex->count = 1;
 
 	/* Did we timeout or have an error */
 	if (status < 0) {
@@ -140,32 +157,86 @@ static int _cnd_wait(cnd_t *cnd, mtx_t *mtx, unsigned long msec)
 
 int	cnd_wait(cnd_t *cnd, mtx_t *mtx)
 {
-	return _cnd_wait(cnd, mtx, SCHEDULER_WAIT_FOREVER);
+	return _cnd_wait(cnd, mtx, ULLONG_MAX);
 }
 
 int	cnd_timedwait(cnd_t *cnd, mtx_t *mtx, const struct timespec *tm)
 {
 	assert(tm != 0);
 
-	unsigned long ticks = scheduler_get_ticks();
-	unsigned long long tm_ticks = (tm->tv_sec * 1000) + (tm->tv_nsec / 1000000);
+	unsigned long long deadline = _timespec_to_ticks(tm);
 
 	/* Have we already miss the timeout? */
-	if (ticks < tm_ticks || tm_ticks - ticks >= UINT32_MAX)
+	if (deadline <= scheduler_get_ticks64())
 		return thrd_timedout;
 
-	return _cnd_wait(cnd, mtx, tm_ticks - ticks);
+	return _cnd_wait(cnd, mtx, deadline);
+}
+
+int _cnd_wait_any(cnd_t *const cnds[], unsigned long count, mtx_t *mtx, const struct timespec *tm, unsigned long *index)
+{
+	assert(cnds != 0 && mtx != 0 && index != 0);
+
+	/* The scheduler bounds the number of addresses in a vectored wait */
+	if (count == 0 || count > SCHEDULER_FUTEX_WAITV_MAX) {
+		errno = EINVAL;
+		return thrd_error;
+	}
+
+	/* Bind every condition to the mutex and snapshot its sequence, just like a single wait */
+	struct futex_waitv waiters[SCHEDULER_FUTEX_WAITV_MAX];
+	for (unsigned long i = 0; i < count; ++i) {
+		struct mtx *expected = 0;
+		if (cnds[i]->mutex != mtx) {
+			atomic_compare_exchange_strong(&cnds[i]->mutex, &expected, mtx);
+			if (cnds[i]->mutex != mtx) {
+				errno = EINVAL;
+				return thrd_error;
+			}
+		}
+		waiters[i].addr = (long *)&cnds[i]->sequence;
+		waiters[i].value = cnds[i]->sequence;
+	}
+
+	mtx_unlock(mtx);
+	int status = tm ? scheduler_futex_waitv_until(waiters, count, _timespec_to_ticks(tm)) : scheduler_futex_waitv(waiters, count, SCHEDULER_WAIT_FOREVER);
+
+	/* Vectored waiters are woken rather than requeued by a broadcast, so never own the mutex here */
+	mtx_lock(mtx);
+
+	/* Signalled before we slept, report the first condition which moved on */
+	if (status == -EAGAIN) {
+		status = 0;
+		for (unsigned long i = 0; i < count; ++i)
+			if ((long)cnds[i]->sequence != waiters[i].value) {
+				status = i;
+				break;
+			}
+	}
+
+	/* Did we timeout or have an error */
+	if (status < 0) {
+		errno = -status;
+		return status == -ETIMEDOUT ? thrd_timedout : thrd_error;
+	}
+
+	*index = status;
+	return thrd_success;
 }
 
-static int _cnd_wakeup(struct cnd *cnd, bool all)
+static int _cnd_wakeup(struct cnd *cnd, unsigned long count)
 {
 	assert(cnd != 0);
 
 	/* We are waking someone up */
-	atomic_fetch_add(&cnd->sequence, 1);
+	unsigned long sequence = atomic_fetch_add(&cnd->sequence, 1) + 1;
+
+	/* Wake one waiter and move the rest onto the mutex, they would only contend for it anyway */
+	if (count == ULONG_MAX && cnd->mutex && scheduler_futex_requeue((long *)&cnd->sequence, sequence, &cnd->mutex->futex) >= 0)
+		return thrd_success;
 
 	/* Wake some waiters */
-	scheduler_futex_wake(&cnd->futex, all);
+	scheduler_futex_wake_addr_n((long *)&cnd->sequence, count);
 
 	/* March on */
 	return thrd_success;
@@ -173,12 +244,17 @@ static int _cnd_wakeup(struct cnd *cnd, bool all)
 
 int	cnd_signal(cnd_t *cnd)
 {
-	return _cnd_wakeup(cnd, false);
+	return _cnd_wakeup(cnd, 1);
 }
 
 int	cnd_broadcast(cnd_t *cnd)
 {
-	return _cnd_wakeup(cnd, true);
+	return _cnd_wakeup(cnd, ULONG_MAX);
+}
+
+int _cnd_signal_n(cnd_t *cnd, unsigned long count)
+{
+	return _cnd_wakeup(cnd, count);
 }
 
 int mtx_init(mtx_t *mtx, int type)
@@ -226,7 +302,7 @@ int mtx_trylock(mtx_t *mtx)
 	return thrd_success;
 }
 
-static int _mtx_lock(mtx_t *mtx, unsigned long msec)
+static int _mtx_lock(mtx_t *mtx, unsigned long long deadline)
 {
 	assert(mtx != 0);
 
@@ -245,8 +321,8 @@ static int _mtx_lock(mtx_t *mtx, unsigned long msec)
 	long expected = 0;
 	while (!atomic_compare_exchange_strong(&mtx->value, &expected, value)) {
 
-		/* We did not get the lock, wait for it */
-		int status = scheduler_futex_wait(&mtx->futex, expected, msec);
+		/* We did not get the lock, wait for it, a deadline holds across retries */
+		int status = deadline == ULLONG_MAX ? scheduler_futex_wait(&mtx->futex, expected, SCHEDULER_WAIT_FOREVER) : scheduler_futex_wait_until(&mtx->futex, expected, deadline);
 		if (status < 0) {
 			errno = -status;
 			return status == -ETIMEDOUT ? thrd_timedout : thrd_error;
@@ -270,7 +346,7 @@ static int _mtx_lock(mtx_t *mtx, unsigned long msec)
 
 int mtx_lock(mtx_t *mtx)
 {
-	return _mtx_lock(mtx, SCHEDULER_WAIT_FOREVER);
+	return _mtx_lock(mtx, ULLONG_MAX);
 }
 
 int mtx_timedlock(mtx_t *mtx, const struct timespec *tm)
@@ -283,14 +359,8 @@ int mtx_timedlock(mtx_t *mtx, const struct timespec *tm)
 		return thrd_error;
 	}
 
-	unsigned long ticks = scheduler_get_ticks();
-	unsigned long long tm_ticks = (tm->tv_sec * 1000) + (tm->tv_nsec / 1000000);
-
-	/* Have we already miss the timeout? */
-	if (ticks < tm_ticks || tm_ticks - ticks >= UINT32_MAX)
-		return thrd_timedout;
-
-	return _mtx_lock(mtx, tm_ticks - ticks);
+	/* A passed deadline still takes a free mutex */
+	return _mtx_lock(mtx, _timespec_to_ticks(tm));
 }
 
 int mtx_unlock(mtx_t *mtx)
@@ -424,6 +494,7 @@ static void thrds_init(void)
 	thread->detached = false;
 	thread->terminated = false;
 	thread->joiner = 0;
+	thread->pool = 0;
 	list_init(&thread->thrd_node);
 	thread->marker = __THRD_MARKER;
 
@@ -465,14 +536,16 @@ int	_thrd_create(thrd_t *thrd, int (*func)(void *), void *arg, thrd_attr_t *attr
 {
 	call_once(&thrds_init_flag, thrds_init);
 
-	/* Allocate the stack */
-	struct thrd *thread = _thrd_alloc(attr->stack_size);
+	/* Allocate the stack, from the pool if one was given */
+	struct thrd *thread = attr->pool ? scheduler_task_pool_alloc(attr->pool, attr->stack_size) : _thrd_alloc(attr->stack_size);
 	if (!thread) {
 		errno = ENOMEM;
 		return thrd_error;
 	}
 
-	/* Initialize the thread block */
+	/* Initialize the thread block, pooled blocks are recycled without clearing */
+	thread->pool = attr->pool;
+	memset(thread->tss, 0, sizeof(thread->tss));
 	thread->func = func;
 	thread->context = arg;
 	thread->detached = false;
@@ -494,6 +567,7 @@ int	_thrd_create(thrd_t *thrd, int (*func)(void *), void *arg, thrd_attr_t *attr
 	desc.flags = attr->flags;
 	desc.priority = attr->priority;
 	desc.affinity = attr->affinity;
+	desc.quantum = 0;
 
 	/* Carefully add to the threads list for clean up */
 	if (mtx_lock(&thrds_lock) != thrd_success)
@@ -522,7 +596,7 @@ error_remove_thrds:
 		abort();
 
 error_release_thrd:
-	_thrd_release(thread);
+	_thrd_free(thread);
 
 	return thrd_error;
 }
@@ -530,7 +604,7 @@ error_release_thrd:
 int	thrd_create(thrd_t *thrd, thrd_start_t func, void *arg)
 {
 	assert(thrd != 0 && func != 0);
-	struct thrd_attr attr = { .stack_size = __THRD_STACK_SIZE, .flags = 0, .priority = __THRD_PRIORITY, .affinity = UINT32_MAX, };
+	struct thrd_attr attr = { .stack_size = __THRD_STACK_SIZE, .flags = 0, .priority = __THRD_PRIORITY, .affinity = UINT32_MAX, .pool = 0 };
 	return _thrd_create(thrd, func, arg, &attr);
 }
 
@@ -559,7 +633,7 @@ static int thrds_reaper(void *context)
 		list_for_each_entry_mutable(entry, current, &thrds, thrd_node) {
 			if (entry->detached && entry->terminated) {
 				list_remove(&entry->thrd_node);
-				_thrd_release(entry);
+				_thrd_free(entry);
 			}
 		}
 	}
@@ -687,7 +761,7 @@ int	thrd_join(thrd_t thrd, int *res)
 		*res = thread->ret;
 
 	/* Clean up memory */
-	_thrd_release(thread);
+	_thrd_free(thread);
 
 	/* All good */
 	return status;
@@ -725,4 +799,5 @@ void _thdr_attr_init(thrd_attr_t *attr, unsigned long flags, unsigned long prior
 	attr->priority = priority;
 	attr->stack_size = stack_size;
 	attr->affinity = affinity;
+	attr->pool = 0;
 }
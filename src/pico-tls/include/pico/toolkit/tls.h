@@ -25,6 +25,7 @@
 #define cls_core_ptr(core) ({extern void *__aeabi_read_core_cls(unsigned long);__aeabi_read_core_cls(core);})
 #define cls_datum_ptr(datum) ((typeof(datum) *)(cls_ptr() + cls_offset(datum)))
 #define cls_datum(datum) (*(cls_datum_ptr(datum)))
+#define cls_datum_at(cls, datum) (*((typeof(datum) *)((cls) + cls_offset(datum))))
 #define cls_datum_core_ptr(core, datum) ((typeof(datum) *)(cls_core_ptr(core) + cls_offset(datum)))
 #define cls_datum_core(core, datum) (*(cls_datum_core_ptr(core, datum)))
 
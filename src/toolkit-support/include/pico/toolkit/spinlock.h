@@ -44,7 +44,7 @@ static inline bool spin_try_lock(spinlock_t *spinlock)
 {
 	assert(spinlock != 0);
 
-	uint32_t value = *spinlock;
+	unsigned long value = *spinlock;
 	if ((value >> 16) != (value & 0xffff))
 		return false;
 
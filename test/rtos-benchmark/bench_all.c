@@ -9,8 +9,19 @@ extern void bench_mutex_lock_unlock_test(void *arg);
 extern void bench_sem_context_switch_init(void *arg);
 extern void bench_sem_signal_release_init(void *arg);
 extern void bench_thread_yield(void *arg);
+extern void bench_thread_switch_scaling(void *arg);
 extern void bench_malloc_free(void *arg);
 extern void bench_message_queue_init(void *arg);
+extern void bench_multicore_contention(void *arg);
+extern void bench_timeout_scaling(void *arg);
+extern void bench_mutex_scaling(void *arg);
+extern void bench_cnd_broadcast(void *arg);
+extern void bench_pi_chain(void *arg);
+extern void bench_edf(void *arg);
+extern void bench_sem_release_n(void *arg);
+extern void bench_thread_pool(void *arg);
+extern void bench_periodic(void *arg);
+extern void bench_wait_any(void *arg);
 
 void bench_all(void *arg)
 {
@@ -21,12 +32,24 @@ void bench_all(void *arg)
 	bench_sem_context_switch_init(arg);
 	bench_sem_signal_release_init(arg);
 	bench_thread_yield(arg);
+	bench_thread_switch_scaling(arg);
 	bench_malloc_free(arg);
 	bench_message_queue_init(arg);
-
-	/* This should be the last test as it can muck with the timer */
-
+	bench_multicore_contention(arg);
+	bench_timeout_scaling(arg);
+	bench_mutex_scaling(arg);
+	bench_cnd_broadcast(arg);
+	bench_pi_chain(arg);
+	bench_edf(arg);
+	bench_sem_release_n(arg);
+	bench_thread_pool(arg);
+	bench_periodic(arg);
+	bench_wait_any(arg);
+
+	/* This should be the last test as it can muck with the timer, the host port has no cycle timer to muck with */
+#if !PICO_TOOLKIT_HOST
 	bench_interrupt_latency_test(arg);
+#endif
 
 	PRINTF("\n\r *** Done! ***\n\r");
 }
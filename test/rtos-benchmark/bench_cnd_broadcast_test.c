@@ -0,0 +1,145 @@
+// SPDX-License-Identifier: Apache-2.0
+
+/**
+ * @file
+ *
+ * @brief Measure the cost of a condition variable broadcast
+ *
+ * A set of waiters block on a condition variable protected by a mutex
+ * and the main thread broadcasts while holding the mutex. The broadcast
+ * wakes one waiter and requeues the rest onto the mutex so each unlock
+ * hands the mutex to the next waiter. This is compared against waking
+ * every waiter at once, where all but one of them immediately block
+ * again on the mutex. The reported time is from the broadcast until
+ * the last waiter has passed through the mutex.
+ */
+
+#include <threads.h>
+
+#include "bench_api.h"
+#include "bench_utils.h"
+
+#define MAIN_PRIORITY   (BENCH_LAST_PRIORITY - 3)
+#define WAITER_PRIORITY (MAIN_PRIORITY + 1)
+
+#define READY_SEM       3
+#define DONE_SEM        4
+#define NUM_WAITERS     16
+
+static mtx_t lock;
+static cnd_t released;
+static bool go;
+
+/**
+ * @brief Entry point of the waiters, block until released by a broadcast
+ */
+static void bench_cnd_broadcast_waiter(void *args)
+{
+	mtx_lock(&lock);
+
+	bench_sem_give(READY_SEM);
+
+	while (!go)
+		cnd_wait(&released, &lock);
+
+	mtx_unlock(&lock);
+
+	bench_sem_give(DONE_SEM);
+
+	bench_thread_exit();
+}
+
+/**
+ * @brief Release the waiters by waking all of them, the pre-requeue broadcast
+ */
+static void bench_cnd_stampede(cnd_t *cnd)
+{
+	atomic_fetch_add(&cnd->sequence, 1);
+	scheduler_futex_wake_addr((long *)&cnd->sequence, true);
+}
+
+/**
+ * @brief Release the waiters with a broadcast, which requeues them onto the mutex
+ */
+static void bench_cnd_requeue(cnd_t *cnd)
+{
+	cnd_broadcast(cnd);
+}
+
+/**
+ * @brief Measure releasing all waiters with the given wakeup function
+ */
+static void gather_stats(const char *description, void (*release)(cnd_t *cnd))
+{
+	bench_time_t  start;
+	bench_time_t  end;
+
+	go = false;
+
+	for (int i = 0; i < NUM_WAITERS; i++)
+		bench_thread_spawn(i, "waiter", WAITER_PRIORITY, bench_cnd_broadcast_waiter, 0);
+
+	for (int i = 0; i < NUM_WAITERS; i++)
+		bench_sem_take(READY_SEM);
+
+	/* Every waiter has released the mutex by waiting on the condition once we own it */
+	mtx_lock(&lock);
+
+	start = bench_timing_counter_get();
+
+	go = true;
+	release(&released);
+	mtx_unlock(&lock);
+
+	for (int i = 0; i < NUM_WAITERS; i++)
+		bench_sem_take(DONE_SEM);
+
+	end = bench_timing_counter_get();
+
+	bench_collect_resources();
+
+	PRINTF(" %-40s: %6llu\n\r", description, bench_timing_cycles_to_ns(bench_timing_cycles_get(&start, &end)));
+}
+
+/**
+ * @brief Test for the condition variable broadcast benchmarking
+ */
+void bench_cnd_broadcast(void *arg)
+{
+	bench_timing_init();
+
+	bench_thread_set_priority(MAIN_PRIORITY);
+
+	bench_sem_create(READY_SEM, 0, NUM_WAITERS);
+	bench_sem_create(DONE_SEM, 0, NUM_WAITERS);
+
+	if (mtx_init(&lock, mtx_plain) != thrd_success || cnd_init(&released) != thrd_success) {
+		PRINTF("failed to create the broadcast mutex or condition\n\r");
+		return;
+	}
+
+	PRINTF("** Condition broadcast stats [%d waiters] in nanoseconds **\n\r", NUM_WAITERS);
+
+	bench_timing_start();
+
+	gather_stats("Broadcast wake all", bench_cnd_stampede);
+	gather_stats("Broadcast requeue", bench_cnd_requeue);
+
+	bench_timing_stop();
+
+	cnd_destroy(&released);
+	mtx_destroy(&lock);
+}
+
+#ifdef RUN_CND_BROADCAST
+int main(void)
+{
+	PRINTF("\n\r *** Starting! ***\n\n\r");
+
+	bench_test_init(bench_cnd_broadcast);
+
+	PRINTF("\n\r *** Done! ***\n\r");
+
+	return 0;
+}
+#endif
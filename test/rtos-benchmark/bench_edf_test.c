@@ -0,0 +1,193 @@
+// SPDX-License-Identifier: Apache-2.0
+
+/**
+ * @file
+ *
+ * @brief Schedulability of a periodic task set under EDF and fixed priorities
+ *
+ * Two periodic tasks share one core, the first needs 2 ticks every 5 ticks
+ * and the second 4 ticks every 7 ticks, for a utilisation of 97%. The jobs
+ * spin for 90% of their budget. Under rate monotonic fixed priorities the
+ * second task misses deadlines, its response time is 7.2 ticks against a
+ * deadline of 7. Under EDF the set is schedulable and no deadlines should
+ * be missed. A third EDF task needing 10% of the core must then be refused
+ * by admission control.
+ */
+
+#include <errno.h>
+
+#include <pico/toolkit/scheduler.h>
+
+#include "bench_api.h"
+#include "bench_utils.h"
+
+#define MAIN_PRIORITY   (BENCH_LAST_PRIORITY - 5)
+
+#define NUM_TASKS       2
+#define STACK_SIZE      2048
+#define RUN_TICKS       1400
+#define WORK_PERCENT    90
+
+struct bench_edf_task
+{
+	const char *name;
+	unsigned long budget;
+	unsigned long period;
+	unsigned long jobs;
+	unsigned long misses;
+	unsigned long release;
+	bool edf;
+	struct task *task;
+};
+
+static struct bench_edf_task tasks[NUM_TASKS] =
+{
+	{ .name = "2 every 5 ticks", .budget = 2, .period = 5 },
+	{ .name = "4 every 7 ticks", .budget = 4, .period = 7 },
+};
+
+static uint8_t stacks[NUM_TASKS + 1][STACK_SIZE] __aligned(8);
+
+/**
+ * @brief Spin for the given number of nanoseconds without blocking
+ */
+static void bench_edf_spin(bench_time_t ns)
+{
+	bench_time_t start = bench_timing_counter_get();
+	bench_time_t now;
+
+	do
+		now = bench_timing_counter_get();
+	while (bench_timing_cycles_to_ns(bench_timing_cycles_get(&start, &now)) < ns);
+}
+
+/**
+ * @brief Wait for the next release of a fixed priority task, returns true if the deadline was missed
+ */
+static bool bench_edf_fixed_wait(struct bench_edf_task *periodic)
+{
+	unsigned long now = scheduler_get_ticks();
+	bool missed = (int32_t)(now - (periodic->release + periodic->period)) > 0;
+
+	/* Same release rules as the EDF tasks, overruns skip the missed releases */
+	periodic->release += periodic->period;
+	if ((int32_t)(now - periodic->release) >= 0)
+		periodic->release += ((now - periodic->release) / periodic->period) * periodic->period;
+	else
+		scheduler_sleep(periodic->release - now);
+
+	return missed;
+}
+
+/**
+ * @brief Entry point of the periodic tasks
+ */
+static void bench_edf_periodic(void *args)
+{
+	struct bench_edf_task *periodic = args;
+	bench_time_t work = periodic->budget * 1000000ULL / SCHEDULER_TICK_FREQ * WORK_PERCENT / 100;
+
+	periodic->release = scheduler_get_ticks();
+
+	for (unsigned long job = 0; job < periodic->jobs; ++job) {
+
+		bench_edf_spin(work);
+
+		if (periodic->edf) {
+			if (scheduler_edf_wait_period() == -ETIMEDOUT)
+				++periodic->misses;
+		} else if (bench_edf_fixed_wait(periodic))
+			++periodic->misses;
+	}
+
+	scheduler_terminate(0);
+}
+
+/**
+ * @brief Create a periodic task pinned to the given core
+ */
+static struct task *bench_edf_create(void *stack, struct bench_edf_task *periodic, unsigned long priority, unsigned long core)
+{
+	struct task_descriptor desc =
+	{
+		.entry_point = bench_edf_periodic,
+		.context = periodic,
+		.flags = SCHEDULER_CORE_AFFINITY | (periodic->edf ? SCHEDULER_TASK_EDF : 0),
+		.priority = priority,
+		.affinity = core,
+		.period = periodic->period,
+		.deadline = periodic->period,
+		.budget = periodic->budget,
+	};
+
+	return scheduler_create(stack, STACK_SIZE, &desc);
+}
+
+/**
+ * @brief Run the task set on one core, either EDF or rate monotonic
+ */
+static void gather_stats(const char *description, bool edf, unsigned long core)
+{
+	/* Shorter periods get higher fixed priorities, just below the EDF band */
+	for (int i = 0; i < NUM_TASKS; i++) {
+		tasks[i].jobs = RUN_TICKS / tasks[i].period;
+		tasks[i].misses = 0;
+		tasks[i].edf = edf;
+		tasks[i].task = bench_edf_create(stacks[i], &tasks[i], SCHEDULER_EDF_PRIORITY + 1 + i, core);
+		if (!tasks[i].task) {
+			PRINTF("failed to create periodic task %d: %d\n\r", i, errno);
+			return;
+		}
+	}
+
+	/* Try to overload the core, admission control must refuse */
+	if (edf) {
+		struct bench_edf_task extra = { .budget = 1, .period = 10, .jobs = 0, .edf = true };
+		struct task *task = bench_edf_create(stacks[NUM_TASKS], &extra, 0, core);
+		PRINTF(" %-40s: %s\n\r", "Admit 10% more at 97%", task ? "admitted" : errno == EBUSY ? "refused" : "failed");
+
+		/* Without jobs an admitted task terminates at once */
+		while (task && scheduler_get_state(task) != TASK_TERMINATED)
+			scheduler_sleep(1);
+	}
+
+	/* Wait for all jobs to complete */
+	for (int i = 0; i < NUM_TASKS; i++)
+		while (scheduler_get_state(tasks[i].task) != TASK_TERMINATED)
+			scheduler_sleep(1);
+
+	for (int i = 0; i < NUM_TASKS; i++)
+		PRINTF(" %-18s %-21s: %6lu of %lu missed\n\r", description, tasks[i].name, tasks[i].misses, tasks[i].jobs);
+}
+
+/**
+ * @brief Test for the EDF schedulability benchmarking
+ */
+void bench_edf(void *arg)
+{
+	bench_timing_init();
+
+	bench_thread_set_priority(MAIN_PRIORITY);
+
+	PRINTF("** EDF schedulability [97%% utilisation, %lu ticks] **\n\r", (unsigned long)RUN_TICKS);
+
+	bench_timing_start();
+
+	gather_stats("Rate monotonic", false, scheduler_num_cores() - 1);
+	gather_stats("EDF", true, scheduler_num_cores() - 1);
+
+	bench_timing_stop();
+}
+
+#ifdef RUN_EDF
+int main(void)
+{
+	PRINTF("\n\r *** Starting! ***\n\n\r");
+
+	bench_test_init(bench_edf);
+
+	PRINTF("\n\r *** Done! ***\n\r");
+
+	return 0;
+}
+#endif
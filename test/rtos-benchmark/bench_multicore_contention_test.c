@@ -0,0 +1,99 @@
+// SPDX-License-Identifier: Apache-2.0
+
+/**
+ * @file
+ *
+ * @brief Measure context switch throughput when both cores are switching
+ *
+ * A number of worker threads each perform a fixed number of yields and then
+ * signal the main thread. With one worker only a single core is switching,
+ * with two or more workers both cores are switching at the same time. The
+ * time per yield should stay close to the single worker case when the cores
+ * do not serialize on the scheduler.
+ */
+
+#include "bench_api.h"
+#include "bench_utils.h"
+
+#define MAIN_PRIORITY   (BENCH_LAST_PRIORITY - 3)
+#define WORKER_PRIORITY (MAIN_PRIORITY + 1)
+
+#define DONE_SEM        4
+#define MAX_WORKERS     8
+
+static const int workers[] = { 1, 2, 4, MAX_WORKERS };
+
+/**
+ * @brief Entry point of the yielding workers
+ */
+static void bench_contention_worker(void *args)
+{
+	ARG_UNUSED(args);
+
+	for (uint32_t i = 0; i < ITERATIONS; i++)
+		bench_yield();
+
+	bench_sem_give(DONE_SEM);
+
+	bench_thread_exit();
+}
+
+/**
+ * @brief Measure the yield throughput with the given number of workers
+ */
+static void gather_stats(int count)
+{
+	bench_time_t  start;
+	bench_time_t  end;
+	char description[64];
+
+	/* The workers are lower priority, nothing runs until we block on the semaphore */
+	start = bench_timing_counter_get();
+
+	for (int i = 0; i < count; i++)
+		bench_thread_spawn(i, "worker", WORKER_PRIORITY, bench_contention_worker, NULL);
+
+	for (int i = 0; i < count; i++)
+		bench_sem_take(DONE_SEM);
+
+	end = bench_timing_counter_get();
+
+	bench_collect_resources();
+
+	snprintf(description, sizeof(description), "Yield throughput (%d workers)", count);
+	PRINTF(" %-40s: %6llu\n\r", description, bench_timing_cycles_to_ns(bench_timing_cycles_get(&start, &end)) / (ITERATIONS * count));
+}
+
+/**
+ * @brief Test for the multicore contention benchmarking
+ */
+void bench_multicore_contention(void *arg)
+{
+	bench_timing_init();
+
+	bench_thread_set_priority(MAIN_PRIORITY);
+
+	bench_sem_create(DONE_SEM, 0, MAX_WORKERS);
+
+	PRINTF("** Multicore contention stats [avg] in nanoseconds per yield **\n\r");
+
+	bench_timing_start();
+
+	for (unsigned int i = 0; i < sizeof(workers) / sizeof(workers[0]); i++)
+		gather_stats(workers[i]);
+
+	bench_timing_stop();
+}
+
+#ifdef RUN_MULTICORE_CONTENTION
+int main(void)
+{
+	PRINTF("\n\r *** Starting! ***\n\n\r");
+
+	bench_test_init(bench_multicore_contention);
+
+	PRINTF("\n\r *** Done! ***\n\r");
+
+	return 0;
+}
+#endif
@@ -0,0 +1,146 @@
+// SPDX-License-Identifier: Apache-2.0
+
+/**
+ * @file
+ *
+ * @brief Measure contended mutex throughput on independent mutexes
+ *
+ * Each lane is a pair of worker threads contending for their own mutex,
+ * a worker yields while holding the mutex so its partner blocks on the
+ * futex and every unlock has to wake a waiter. Lanes share nothing, so
+ * with two lanes each core runs one and the time per lock/unlock pair
+ * should drop to about half of the single lane case when the wait and
+ * wake paths do not serialize on the scheduler. Two lanes must be at least
+ * MIN_SPEEDUP_PERCENT faster than one whenever two cores run in parallel.
+ */
+
+#include <unistd.h>
+
+#include <pico/toolkit/scheduler.h>
+
+#include "bench_api.h"
+#include "bench_utils.h"
+
+#define MAIN_PRIORITY   (BENCH_LAST_PRIORITY - 3)
+#define WORKER_PRIORITY (MAIN_PRIORITY + 1)
+
+#define DONE_SEM        4
+#define FIRST_MUTEX     1
+#define MAX_LANES       4
+#define LANE_WORKERS    2
+#define MIN_SPEEDUP_PERCENT 125
+
+static const int lanes[] = { 1, 2, MAX_LANES };
+
+/**
+ * @brief Entry point of the mutex workers, the argument is the lane
+ */
+static void bench_mutex_scaling_worker(void *args)
+{
+	int mutex_id = FIRST_MUTEX + (int)(uintptr_t)args;
+
+	for (uint32_t i = 0; i < ITERATIONS; i++) {
+		bench_mutex_lock(mutex_id);
+		bench_yield();
+		bench_mutex_unlock(mutex_id);
+	}
+
+	bench_sem_give(DONE_SEM);
+
+	bench_thread_exit();
+}
+
+/**
+ * @brief Check if the lanes can run at the same time
+ */
+static bool bench_mutex_scaling_parallel(void)
+{
+#if PICO_TOOLKIT_HOST
+	/* The cores are host threads, they only run in parallel on as many host processors */
+	if (sysconf(_SC_NPROCESSORS_ONLN) < 2)
+		return false;
+#endif
+
+	return scheduler_num_cores() > 1;
+}
+
+/**
+ * @brief Measure the lock/unlock throughput with the given number of lanes, returns the time per pair
+ */
+static uint64_t gather_stats(int count)
+{
+	uint64_t pair_ns;
+	bench_time_t  start;
+	bench_time_t  end;
+	char description[64];
+
+	/* The workers are lower priority, nothing runs until we block on the semaphore */
+	start = bench_timing_counter_get();
+
+	for (int i = 0; i < count * LANE_WORKERS; i++)
+		bench_thread_spawn(i, "worker", WORKER_PRIORITY, bench_mutex_scaling_worker, (void *)(uintptr_t)(i / LANE_WORKERS));
+
+	for (int i = 0; i < count * LANE_WORKERS; i++)
+		bench_sem_take(DONE_SEM);
+
+	end = bench_timing_counter_get();
+
+	bench_collect_resources();
+
+	pair_ns = bench_timing_cycles_to_ns(bench_timing_cycles_get(&start, &end)) / (ITERATIONS * count * LANE_WORKERS);
+
+	snprintf(description, sizeof(description), "Contended lock/unlock (%d mutexes)", count);
+	PRINTF(" %-40s: %6llu\n\r", description, pair_ns);
+
+	return pair_ns;
+}
+
+/**
+ * @brief Test for the independent mutex scaling benchmarking
+ */
+void bench_mutex_scaling(void *arg)
+{
+	bench_timing_init();
+
+	bench_thread_set_priority(MAIN_PRIORITY);
+
+	bench_sem_create(DONE_SEM, 0, MAX_LANES * LANE_WORKERS);
+
+	for (int i = 0; i < MAX_LANES; i++)
+		bench_mutex_create(FIRST_MUTEX + i);
+
+	PRINTF("** Independent mutex scaling stats [avg] in nanoseconds per lock/unlock **\n\r");
+
+	bench_timing_start();
+
+	uint64_t pair_ns[sizeof(lanes) / sizeof(lanes[0])];
+	for (unsigned int i = 0; i < sizeof(lanes) / sizeof(lanes[0]); i++)
+		pair_ns[i] = gather_stats(lanes[i]);
+
+	bench_timing_stop();
+
+	/* Lanes on one core only interleave, there is no speedup to check */
+	if (!bench_mutex_scaling_parallel()) {
+		PRINTF(" %-40s: %s\n\r", "Two lane speedup", "n/a");
+		return;
+	}
+
+	/* The first two entries are the single and two lane cases */
+	uint64_t speedup = pair_ns[1] ? pair_ns[0] * 100 / pair_ns[1] : 0;
+	PRINTF(" %-40s: %5llu%%\n\r", "Two lane speedup", speedup);
+	if (speedup < MIN_SPEEDUP_PERCENT)
+		PRINTF(" FAILED: two lane speedup is below %d%%\n\r", MIN_SPEEDUP_PERCENT);
+}
+
+#ifdef RUN_MUTEX_SCALING
+int main(void)
+{
+	PRINTF("\n\r *** Starting! ***\n\n\r");
+
+	bench_test_init(bench_mutex_scaling);
+
+	PRINTF("\n\r *** Done! ***\n\r");
+
+	return 0;
+}
+#endif
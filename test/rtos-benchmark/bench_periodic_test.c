@@ -0,0 +1,100 @@
+// SPDX-License-Identifier: Apache-2.0
+
+/**
+ * @file
+ *
+ * @brief Measure the drift of a periodic loop
+ *
+ * A thread runs a fixed number of periods, doing one tick worth of work in
+ * each. This is done sleeping for the period after the work, where the time
+ * spent working adds up, and sleeping until the next absolute release with
+ * osDelayUntil(), where it does not. The reported value is how many ticks
+ * the last release was late compared to an ideal periodic schedule.
+ */
+
+#include <cmsis/cmsis-rtos2.h>
+
+#include "bench_api.h"
+#include "bench_utils.h"
+
+#define MAIN_PRIORITY   (BENCH_LAST_PRIORITY - 3)
+
+#define PERIOD          5
+#define NUM_PERIODS     20
+
+/**
+ * @brief Busy for one tick, standing in for the work of a period
+ */
+static void bench_periodic_work(void)
+{
+	uint32_t start = osKernelGetTickCount();
+	while (osKernelGetTickCount() == start);
+}
+
+/**
+ * @brief Sleep for the period after the work of each release
+ */
+static uint32_t bench_periodic_relative(void)
+{
+	uint32_t start = osKernelGetTickCount();
+
+	for (int i = 0; i < NUM_PERIODS; i++) {
+		bench_periodic_work();
+		osDelay(PERIOD);
+	}
+
+	return osKernelGetTickCount() - start;
+}
+
+/**
+ * @brief Sleep until the absolute time of the next release
+ */
+static uint32_t bench_periodic_absolute(void)
+{
+	uint32_t start = osKernelGetTickCount();
+	uint32_t release = start;
+
+	for (int i = 0; i < NUM_PERIODS; i++) {
+		bench_periodic_work();
+		release += PERIOD;
+		osDelayUntil(release);
+	}
+
+	return osKernelGetTickCount() - start;
+}
+
+/**
+ * @brief Report the drift of a periodic loop
+ */
+static void gather_stats(const char *description, uint32_t (*loop)(void))
+{
+	uint32_t elapsed = loop();
+
+	PRINTF(" %-40s: %6ld\n\r", description, (long)(elapsed - PERIOD * NUM_PERIODS));
+}
+
+/**
+ * @brief Test for the periodic drift benchmarking
+ */
+void bench_periodic(void *arg)
+{
+	bench_thread_set_priority(MAIN_PRIORITY);
+
+	PRINTF("** Periodic drift stats [%d periods of %d] in ticks **\n\r", NUM_PERIODS, PERIOD);
+
+	gather_stats("Sleep for the period", bench_periodic_relative);
+	gather_stats("Sleep until the release", bench_periodic_absolute);
+}
+
+#ifdef RUN_PERIODIC
+int main(void)
+{
+	PRINTF("\n\r *** Starting! ***\n\n\r");
+
+	bench_test_init(bench_periodic);
+
+	PRINTF("\n\r *** Done! ***\n\r");
+
+	return 0;
+}
+#endif
@@ -0,0 +1,178 @@
+// SPDX-License-Identifier: Apache-2.0
+
+/**
+ * @file
+ *
+ * @brief Measure the worst case blocking through a priority inheritance chain
+ *
+ * Three low priority threads form a lock chain, the last one owns the third
+ * mutex and works for a short time, the other two each own a mutex and block
+ * on the next one in the chain. A high priority thread then blocks on the
+ * first mutex while a medium priority hog runs on each core. Without
+ * transitive priority inheritance the boost stops at the owner of the first
+ * mutex and the high priority thread is blocked until the hogs finish, with
+ * it the whole chain runs at the high priority and the blocking time is
+ * bounded by the chain work plus three hand overs.
+ */
+
+#include "bench_api.h"
+#include "bench_utils.h"
+
+#define MAIN_PRIORITY   (BENCH_LAST_PRIORITY - 4)
+#define HIGH_PRIORITY   (MAIN_PRIORITY - 1)
+#define HOG_PRIORITY    (MAIN_PRIORITY + 1)
+#define CHAIN_PRIORITY  (MAIN_PRIORITY + 2)
+
+#define STEP_SEM        3
+#define DONE_SEM        4
+#define FIRST_MUTEX     1
+#define CHAIN_LENGTH    3
+#define NUM_HOGS        2
+#define NUM_THREADS     (CHAIN_LENGTH + NUM_HOGS + 1)
+
+#define CHAIN_ITERATIONS 100
+#define CHAIN_WORK_NS    100000ULL
+#define HOG_WORK_NS      2000000ULL
+
+static bench_time_t block_start;
+static bench_time_t block_end;
+
+static struct bench_stats block_times;
+
+/**
+ * @brief Spin for the given number of nanoseconds without blocking
+ */
+static void bench_pi_chain_spin(bench_time_t ns)
+{
+	bench_time_t start = bench_timing_counter_get();
+	bench_time_t now;
+
+	do
+		now = bench_timing_counter_get();
+	while (bench_timing_cycles_to_ns(bench_timing_cycles_get(&start, &now)) < ns);
+}
+
+/**
+ * @brief Entry point of the chain threads, the argument is the position in the chain
+ */
+static void bench_pi_chain_link(void *args)
+{
+	int link = (int)(uintptr_t)args;
+
+	bench_mutex_lock(FIRST_MUTEX + link);
+	bench_sem_give(STEP_SEM);
+
+	/* The end of the chain does the work, the others block on the next link */
+	if (link == CHAIN_LENGTH - 1)
+		bench_pi_chain_spin(CHAIN_WORK_NS);
+	else {
+		bench_mutex_lock(FIRST_MUTEX + link + 1);
+		bench_mutex_unlock(FIRST_MUTEX + link + 1);
+	}
+
+	bench_mutex_unlock(FIRST_MUTEX + link);
+
+	bench_sem_give(DONE_SEM);
+
+	bench_thread_exit();
+}
+
+/**
+ * @brief Entry point of the medium priority hogs
+ */
+static void bench_pi_chain_hog(void *args)
+{
+	ARG_UNUSED(args);
+
+	bench_pi_chain_spin(HOG_WORK_NS);
+
+	bench_sem_give(DONE_SEM);
+
+	bench_thread_exit();
+}
+
+/**
+ * @brief Entry point of the high priority thread, blocks on the head of the chain
+ */
+static void bench_pi_chain_high(void *args)
+{
+	ARG_UNUSED(args);
+
+	block_start = bench_timing_counter_get();
+	bench_mutex_lock(FIRST_MUTEX);
+	block_end = bench_timing_counter_get();
+	bench_mutex_unlock(FIRST_MUTEX);
+
+	bench_sem_give(DONE_SEM);
+
+	bench_thread_exit();
+}
+
+/**
+ * @brief Build the chain from the tail so each link blocks on an owned mutex
+ */
+static void gather_stats(uint32_t iteration)
+{
+	int thread_id = 0;
+
+	for (int link = CHAIN_LENGTH - 1; link >= 0; link--) {
+		bench_thread_spawn(thread_id++, "link", CHAIN_PRIORITY, bench_pi_chain_link, (void *)(uintptr_t)link);
+		bench_sem_take(STEP_SEM);
+	}
+
+	for (int i = 0; i < NUM_HOGS; i++)
+		bench_thread_spawn(thread_id++, "hog", HOG_PRIORITY, bench_pi_chain_hog, NULL);
+
+	bench_thread_spawn(thread_id++, "high", HIGH_PRIORITY, bench_pi_chain_high, NULL);
+
+	for (int i = 0; i < NUM_THREADS; i++)
+		bench_sem_take(DONE_SEM);
+
+	bench_collect_resources();
+
+	bench_stats_update(&block_times, bench_timing_cycles_get(&block_start, &block_end), iteration);
+}
+
+/**
+ * @brief Test for the priority inheritance chain benchmarking
+ */
+void bench_pi_chain(void *arg)
+{
+	bench_timing_init();
+
+	bench_thread_set_priority(MAIN_PRIORITY);
+
+	bench_sem_create(STEP_SEM, 0, 1);
+	bench_sem_create(DONE_SEM, 0, NUM_THREADS);
+
+	for (int i = 0; i < CHAIN_LENGTH; i++)
+		bench_mutex_create(FIRST_MUTEX + i);
+
+	bench_stats_reset(&block_times);
+
+	bench_stats_report_title("Priority inheritance chain stats");
+
+	bench_timing_start();
+
+	for (uint32_t i = 1; i <= CHAIN_ITERATIONS; i++)
+		gather_stats(i);
+
+	bench_timing_stop();
+
+	bench_stats_report_line("Blocked through 3 mutexes", &block_times);
+	PRINTF(" %-40s: %6llu\n\r", "Chain work", CHAIN_WORK_NS);
+	PRINTF(" %-40s: %6llu\n\r", "Hog work", HOG_WORK_NS);
+}
+
+#ifdef RUN_PI_CHAIN
+int main(void)
+{
+	PRINTF("\n\r *** Starting! ***\n\n\r");
+
+	bench_test_init(bench_pi_chain);
+
+	PRINTF("\n\r *** Done! ***\n\r");
+
+	return 0;
+}
+#endif
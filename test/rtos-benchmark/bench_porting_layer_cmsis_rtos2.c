@@ -38,7 +38,7 @@ int picolibc_getc(FILE *file);
 void *_rtos2_alloc(size_t size);
 void _rtos2_release(void *ptr);
 
-static osThreadId_t thread_ids[10] = { 0 };
+static osThreadId_t thread_ids[BENCH_MAX_THREADS] = { 0 };
 static osMessageQueueId_t queue_ids[5] = { 0 };
 static osSemaphoreId_t semaphore_ids[5] = { 0 };
 static osMutexId_t mutex_ids[5] = { 0 };
@@ -129,7 +129,7 @@ int bench_thread_create(int thread_id, const char *thread_name, int priority, vo
 int bench_thread_spawn(int thread_id, const char *thread_name, int priority, void (*entry_function)(void *), void *args)
 {
 	osThreadAttr_t thread_attr = { .name = thread_name, .priority = osKernelPriority(priority) };
-	thread_ids[thread_id] = osThreadNew(entry_function, 0, &thread_attr);
+	thread_ids[thread_id] = osThreadNew(entry_function, args, &thread_attr);
 	if (!thread_ids[thread_id]) {
 		fprintf(stderr, "failed to create thread %d: %d\n", thread_id, errno);
 		return BENCH_ERROR;
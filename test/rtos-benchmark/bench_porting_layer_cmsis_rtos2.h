@@ -30,6 +30,8 @@
 
 #define ITERATIONS 1000
 
+#define BENCH_MAX_THREADS 40
+
 #define BENCH_LAST_PRIORITY (osPriorityNormal)
 
 #define PRINTF printf
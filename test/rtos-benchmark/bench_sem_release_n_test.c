@@ -0,0 +1,131 @@
+// SPDX-License-Identifier: Apache-2.0
+
+/**
+ * @file
+ *
+ * @brief Measure the cost of releasing several semaphore tokens at once
+ *
+ * A set of waiters block on an empty counting semaphore and the main
+ * thread releases one token per waiter. This is done with a release per
+ * token, where only the release taking the count off zero wakes anyone,
+ * and with a single osSemaphoreReleaseN() which wakes one waiter per
+ * token in one service call. The reported time is from the first
+ * release until every waiter has taken its token.
+ */
+
+#include <cmsis/cmsis-rtos2.h>
+
+#include "bench_api.h"
+#include "bench_utils.h"
+
+#define MAIN_PRIORITY   (BENCH_LAST_PRIORITY - 3)
+#define WAITER_PRIORITY (MAIN_PRIORITY + 1)
+
+#define READY_SEM       3
+#define DONE_SEM        4
+#define NUM_WAITERS     16
+
+static osSemaphoreId_t tokens;
+
+/**
+ * @brief Entry point of the waiters, block until a token is released
+ */
+static void bench_sem_release_n_waiter(void *args)
+{
+	bench_sem_give(READY_SEM);
+
+	osSemaphoreAcquire(tokens, osWaitForever);
+
+	bench_sem_give(DONE_SEM);
+
+	bench_thread_exit();
+}
+
+/**
+ * @brief Release the tokens one at a time
+ */
+static void bench_sem_release_each(osSemaphoreId_t semaphore)
+{
+	for (int i = 0; i < NUM_WAITERS; i++)
+		osSemaphoreRelease(semaphore);
+}
+
+/**
+ * @brief Release all the tokens with a single call
+ */
+static void bench_sem_release_bulk(osSemaphoreId_t semaphore)
+{
+	osSemaphoreReleaseN(semaphore, NUM_WAITERS);
+}
+
+/**
+ * @brief Measure releasing a token to every waiter with the given release function
+ */
+static void gather_stats(const char *description, void (*release)(osSemaphoreId_t semaphore))
+{
+	bench_time_t  start;
+	bench_time_t  end;
+
+	for (int i = 0; i < NUM_WAITERS; i++)
+		bench_thread_spawn(i, "waiter", WAITER_PRIORITY, bench_sem_release_n_waiter, 0);
+
+	for (int i = 0; i < NUM_WAITERS; i++)
+		bench_sem_take(READY_SEM);
+
+	/* The waiters run at a higher priority, so each is blocked on the semaphore by now */
+	start = bench_timing_counter_get();
+
+	release(tokens);
+
+	for (int i = 0; i < NUM_WAITERS; i++)
+		bench_sem_take(DONE_SEM);
+
+	end = bench_timing_counter_get();
+
+	bench_collect_resources();
+
+	PRINTF(" %-40s: %6llu\n\r", description, bench_timing_cycles_to_ns(bench_timing_cycles_get(&start, &end)));
+}
+
+/**
+ * @brief Test for the bulk semaphore release benchmarking
+ */
+void bench_sem_release_n(void *arg)
+{
+	bench_timing_init();
+
+	bench_thread_set_priority(MAIN_PRIORITY);
+
+	bench_sem_create(READY_SEM, 0, NUM_WAITERS);
+	bench_sem_create(DONE_SEM, 0, NUM_WAITERS);
+
+	tokens = osSemaphoreNew(NUM_WAITERS, 0, 0);
+	if (!tokens) {
+		PRINTF("failed to create the token semaphore\n\r");
+		return;
+	}
+
+	PRINTF("** Semaphore bulk release stats [%d waiters] in nanoseconds **\n\r", NUM_WAITERS);
+
+	bench_timing_start();
+
+	gather_stats("Release one token at a time", bench_sem_release_each);
+	gather_stats("Release all tokens at once", bench_sem_release_bulk);
+
+	bench_timing_stop();
+
+	osSemaphoreDelete(tokens);
+}
+
+#ifdef RUN_SEM_RELEASE_N
+int main(void)
+{
+	PRINTF("\n\r *** Starting! ***\n\n\r");
+
+	bench_test_init(bench_sem_release_n);
+
+	PRINTF("\n\r *** Done! ***\n\r");
+
+	return 0;
+}
+#endif
@@ -0,0 +1,111 @@
+// SPDX-License-Identifier: Apache-2.0
+
+/**
+ * @file
+ *
+ * @brief Measure the create and join throughput of pooled threads
+ *
+ * A short lived joinable thread of higher priority is created, runs to
+ * completion at once and is joined, over and over. This is done with the
+ * thread and its stack allocated from the heap and with both taken from
+ * a scheduler task pool, which recycles the memory on join. The reported
+ * value is the average time for a create and join pair.
+ */
+
+#include <cmsis/cmsis-rtos2.h>
+
+#include "bench_api.h"
+#include "bench_utils.h"
+
+#define MAIN_PRIORITY   (BENCH_LAST_PRIORITY - 3)
+#define WORKER_PRIORITY (MAIN_PRIORITY + 1)
+
+#define STACK_SIZE      512
+
+#define POOL_SMALL_SIZE 2048
+#define POOL_LARGE_SIZE 4096
+#define POOL_COUNT      2
+
+static const struct task_pool_descriptor pool_classes[] = {
+	{ .block_size = POOL_SMALL_SIZE, .count = POOL_COUNT },
+	{ .block_size = POOL_LARGE_SIZE, .count = POOL_COUNT },
+};
+
+static uint64_t pool_memory[(POOL_SMALL_SIZE + POOL_LARGE_SIZE) * POOL_COUNT / sizeof(uint64_t)];
+static struct task_pool pool;
+static volatile uint32_t runs;
+
+/**
+ * @brief Entry point of the worker, does nothing but exit
+ */
+static void bench_thread_pool_worker(void *args)
+{
+	++runs;
+}
+
+/**
+ * @brief Measure create and join pairs of threads with the given attributes
+ */
+static void gather_stats(const char *description, const osThreadAttr_t *attr, struct task_pool *from)
+{
+	bench_time_t  start;
+	bench_time_t  end;
+
+	runs = 0;
+
+	start = bench_timing_counter_get();
+
+	for (int i = 0; i < ITERATIONS; i++) {
+		osThreadId_t thread = from ? osThreadNewPooled(bench_thread_pool_worker, 0, attr, from) : osThreadNew(bench_thread_pool_worker, 0, attr);
+		if (!thread || osThreadJoin(thread) != osOK) {
+			PRINTF("failed to create or join a worker thread\n\r");
+			return;
+		}
+	}
+
+	end = bench_timing_counter_get();
+
+	if (runs != ITERATIONS)
+		PRINTF(" %-40s: only %u of %u ran\n\r", description, runs, ITERATIONS);
+
+	PRINTF(" %-40s: %6llu\n\r", description, bench_timing_cycles_to_ns(bench_timing_cycles_get(&start, &end)) / ITERATIONS);
+}
+
+/**
+ * @brief Test for the thread pool benchmarking
+ */
+void bench_thread_pool(void *arg)
+{
+	bench_timing_init();
+
+	bench_thread_set_priority(MAIN_PRIORITY);
+
+	if (scheduler_task_pool_init(&pool, pool_memory, sizeof(pool_memory), pool_classes, sizeof(pool_classes) / sizeof(pool_classes[0])) != 0) {
+		PRINTF("failed to initialize the task pool\n\r");
+		return;
+	}
+
+	const osThreadAttr_t attr = { .name = "worker", .attr_bits = osThreadJoinable, .stack_size = STACK_SIZE, .priority = osKernelPriority(WORKER_PRIORITY) };
+
+	PRINTF("** Thread create and join stats [%d iterations] in nanoseconds **\n\r", ITERATIONS);
+
+	bench_timing_start();
+
+	gather_stats("Create and join, heap", &attr, 0);
+	gather_stats("Create and join, task pool", &attr, &pool);
+
+	bench_timing_stop();
+}
+
+#ifdef RUN_THREAD_POOL
+int main(void)
+{
+	PRINTF("\n\r *** Starting! ***\n\n\r");
+
+	bench_test_init(bench_thread_pool);
+
+	PRINTF("\n\r *** Done! ***\n\r");
+
+	return 0;
+}
+#endif
@@ -0,0 +1,110 @@
+// SPDX-License-Identifier: Apache-2.0
+
+/**
+ * @file
+ *
+ * @brief Measure thread context switch cost as the number of ready threads grows
+ *
+ * A growing set of equal priority threads yield to each other in a round robin
+ * together with the main test thread. Each sample is a full round, the time for
+ * one context switch is the round divided by the number of threads taking part.
+ * With an O(1) ready queue the cost per switch should remain flat.
+ */
+
+#include "bench_api.h"
+#include "bench_utils.h"
+#include <stdbool.h>
+
+#define MAIN_PRIORITY   (BENCH_LAST_PRIORITY - 2)
+
+static const int ready_threads[] = { 1, 4, 8, 16, 32 };
+
+static volatile bool yielders_run;
+
+static struct bench_stats time_to_switch;
+
+/**
+ * @brief Entry point of the round robin yield threads
+ */
+static void bench_yielder(void *args)
+{
+	ARG_UNUSED(args);
+
+	while (yielders_run)
+		bench_yield();
+
+	bench_thread_exit();
+}
+
+/**
+ * @brief Measure the round robin switch cost with the given number of ready threads
+ */
+static void gather_stats(int threads)
+{
+	bench_time_t  start;
+	bench_time_t  end;
+	char description[64];
+
+	bench_stats_reset(&time_to_switch);
+
+	/* Start the yielders, they are at our priority so will not run until we yield */
+	yielders_run = true;
+	for (int i = 0; i < threads; i++)
+		bench_thread_spawn(i, "yielder", MAIN_PRIORITY, bench_yielder, NULL);
+
+	/* Let every yielder reach its loop so startup is not measured */
+	bench_yield();
+
+	for (uint32_t i = 1; i <= ITERATIONS; i++) {
+		start = bench_timing_counter_get();
+		bench_yield();
+		end = bench_timing_counter_get();
+
+		bench_stats_update(&time_to_switch, bench_timing_cycles_get(&start, &end), i);
+	}
+
+	/* One more round lets the yielders see the flag and exit */
+	yielders_run = false;
+	bench_yield();
+	bench_collect_resources();
+
+	snprintf(description, sizeof(description), "Yield round (%d ready threads)", threads);
+	bench_stats_report_line(description, &time_to_switch);
+
+	snprintf(description, sizeof(description), "Yield per switch (%d ready threads)", threads);
+	PRINTF(" %-40s: %6llu\n\r", description, bench_timing_cycles_to_ns(time_to_switch.total) / (ITERATIONS * (threads + 1)));
+}
+
+/**
+ * @brief Test for the context switch scaling benchmarking
+ */
+void bench_thread_switch_scaling(void *arg)
+{
+	bench_timing_init();
+
+	/* Lower main test thread priority */
+
+	bench_thread_set_priority(MAIN_PRIORITY);
+
+	bench_stats_report_title("Context switch scaling stats");
+
+	bench_timing_start();
+
+	for (unsigned int i = 0; i < sizeof(ready_threads) / sizeof(ready_threads[0]); i++)
+		gather_stats(ready_threads[i]);
+
+	bench_timing_stop();
+}
+
+#ifdef RUN_THREAD_SWITCH_SCALING
+int main(void)
+{
+	PRINTF("\n\r *** Starting! ***\n\n\r");
+
+	bench_test_init(bench_thread_switch_scaling);
+
+	PRINTF("\n\r *** Done! ***\n\r");
+
+	return 0;
+}
+#endif
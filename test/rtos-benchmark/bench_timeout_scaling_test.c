@@ -0,0 +1,150 @@
+// SPDX-License-Identifier: Apache-2.0
+
+/**
+ * @file
+ *
+ * @brief Measure the cost of arming and cancelling a timeout
+ *
+ * A set of sleeper threads block on a semaphore with long timeouts, so that
+ * 10, 100 and 1000 timeouts are armed. A probe thread then repeatedly blocks
+ * with a timeout (timeout insert) and is released by the main thread before
+ * the timeout expires (timeout cancel). Both measurements include a context
+ * switch, the interesting part is how they change with the number of armed
+ * timeouts. Counts which do not fit in memory are reported as n/a.
+ */
+
+#include "bench_api.h"
+#include "bench_utils.h"
+
+#define MAIN_PRIORITY   (BENCH_LAST_PRIORITY - 3)
+#define PROBE_PRIORITY  (MAIN_PRIORITY - 1)
+
+#define SLEEPER_STACK_SIZE 256
+#define PROBE_TIMEOUT 100000
+
+static const int armed_timeouts[] = { 10, 100, 1000 };
+
+static osSemaphoreId_t sleeper_sem;
+static osSemaphoreId_t probe_sem;
+
+static bench_time_t insert_start;
+static bench_time_t cancel_end;
+
+static struct bench_stats insert_times;
+static struct bench_stats cancel_times;
+
+/**
+ * @brief Sleepers park with a spread of long timeouts until released
+ */
+static void bench_timeout_sleeper(void *args)
+{
+	uint32_t timeout = 60000 + (uintptr_t)args * 7919 % 100000;
+
+	osSemaphoreAcquire(sleeper_sem, timeout);
+}
+
+/**
+ * @brief The probe arms a timeout which is always cancelled by the main thread
+ */
+static void bench_timeout_probe(void *args)
+{
+	ARG_UNUSED(args);
+
+	for (uint32_t i = 1; i <= ITERATIONS; i++) {
+		insert_start = bench_timing_counter_get();
+		osSemaphoreAcquire(probe_sem, PROBE_TIMEOUT);
+		cancel_end = bench_timing_counter_get();
+	}
+}
+
+/**
+ * @brief Measure with the given number of armed timeouts
+ */
+static void gather_stats(int count)
+{
+	osThreadAttr_t sleeper_attr = { .name = "sleeper", .stack_size = SLEEPER_STACK_SIZE, .priority = osKernelPriority(PROBE_PRIORITY) };
+	osThreadAttr_t probe_attr = { .name = "probe", .priority = osKernelPriority(PROBE_PRIORITY) };
+	bench_time_t insert_end;
+	bench_time_t cancel_start;
+	char description[64];
+	int sleepers;
+
+	bench_stats_reset(&insert_times);
+	bench_stats_reset(&cancel_times);
+
+	/* Sleepers are higher priority so each one arms its timeout as it is created */
+	for (sleepers = 0; sleepers < count; sleepers++)
+		if (!osThreadNew(bench_timeout_sleeper, (void *)(uintptr_t)sleepers, &sleeper_attr))
+			break;
+
+	/* Only measure if all the timeouts could be armed */
+	if (sleepers == count && osThreadNew(bench_timeout_probe, 0, &probe_attr)) {
+
+		for (uint32_t i = 1; i <= ITERATIONS; i++) {
+
+			/* The probe has just blocked with a timeout */
+			insert_end = bench_timing_counter_get();
+			bench_stats_update(&insert_times, bench_timing_cycles_get(&insert_start, &insert_end), i);
+
+			/* Release the probe before the timeout */
+			cancel_start = bench_timing_counter_get();
+			osSemaphoreRelease(probe_sem);
+			bench_stats_update(&cancel_times, bench_timing_cycles_get(&cancel_start, &cancel_end), i);
+		}
+
+		snprintf(description, sizeof(description), "Timeout insert (%d armed)", count);
+		bench_stats_report_line(description, &insert_times);
+		snprintf(description, sizeof(description), "Timeout cancel (%d armed)", count);
+		bench_stats_report_line(description, &cancel_times);
+
+	} else {
+
+		snprintf(description, sizeof(description), "Timeout insert (%d armed)", count);
+		bench_stats_report_na(description);
+		snprintf(description, sizeof(description), "Timeout cancel (%d armed)", count);
+		bench_stats_report_na(description);
+	}
+
+	/* Release the sleepers and let the reaper clean up */
+	for (int i = 0; i < sleepers; i++)
+		osSemaphoreRelease(sleeper_sem);
+	bench_collect_resources();
+}
+
+/**
+ * @brief Test for the timeout scaling benchmarking
+ */
+void bench_timeout_scaling(void *arg)
+{
+	bench_timing_init();
+
+	bench_thread_set_priority(MAIN_PRIORITY);
+
+	sleeper_sem = osSemaphoreNew(UINT16_MAX, 0, 0);
+	probe_sem = osSemaphoreNew(1, 0, 0);
+
+	bench_stats_report_title("Timeout scaling stats");
+
+	bench_timing_start();
+
+	for (unsigned int i = 0; i < sizeof(armed_timeouts) / sizeof(armed_timeouts[0]); i++)
+		gather_stats(armed_timeouts[i]);
+
+	bench_timing_stop();
+
+	osSemaphoreDelete(probe_sem);
+	osSemaphoreDelete(sleeper_sem);
+}
+
+#ifdef RUN_TIMEOUT_SCALING
+int main(void)
+{
+	PRINTF("\n\r *** Starting! ***\n\n\r");
+
+	bench_test_init(bench_timeout_scaling);
+
+	PRINTF("\n\r *** Done! ***\n\r");
+
+	return 0;
+}
+#endif
@@ -0,0 +1,160 @@
+// SPDX-License-Identifier: Apache-2.0
+
+/**
+ * @file
+ *
+ * @brief Measure serving several message queues from one thread
+ *
+ * The main thread puts messages alternately into two message queues which
+ * a single consumer of higher priority serves. This is done with a relay
+ * thread per queue forwarding into a combined queue the consumer blocks
+ * on, and with the consumer blocking on both queues at once with
+ * osWaitAny(). The reported value is the average time from a put until
+ * the consumer has the message.
+ */
+
+#include <cmsis/cmsis-rtos2.h>
+
+#include "bench_api.h"
+#include "bench_utils.h"
+
+#define MAIN_PRIORITY     (BENCH_LAST_PRIORITY - 3)
+#define CONSUMER_PRIORITY (MAIN_PRIORITY + 1)
+
+#define DONE_SEM          3
+#define NUM_QUEUES        2
+#define QUEUE_SIZE        4
+#define STOP_MESSAGE      UINT32_MAX
+
+static osMessageQueueId_t queues[NUM_QUEUES];
+static osMessageQueueId_t combined;
+
+/**
+ * @brief Entry point of the relays, forward one queue into the combined queue
+ */
+static void bench_wait_any_relay(void *args)
+{
+	osMessageQueueId_t queue = args;
+	uint32_t message;
+
+	while (osMessageQueueGet(queue, &message, 0, osWaitForever) == osOK && message != STOP_MESSAGE)
+		osMessageQueuePut(combined, &message, 0, osWaitForever);
+
+	bench_thread_exit();
+}
+
+/**
+ * @brief Entry point of the relayed consumer, only sees the combined queue
+ */
+static void bench_wait_any_relayed_consumer(void *args)
+{
+	uint32_t message;
+
+	for (int i = 0; i < ITERATIONS; i++)
+		osMessageQueueGet(combined, &message, 0, osWaitForever);
+
+	bench_sem_give(DONE_SEM);
+
+	bench_thread_exit();
+}
+
+/**
+ * @brief Entry point of the direct consumer, waits on all the queues at once
+ */
+static void bench_wait_any_consumer(void *args)
+{
+	const osWaitAnyItem_t items[NUM_QUEUES] = { { .object_id = queues[0] }, { .object_id = queues[1] } };
+	uint32_t message;
+
+	for (int received = 0; received < ITERATIONS;) {
+		int32_t ready = osWaitAny(items, NUM_QUEUES, osWaitForever);
+		if (ready < 0) {
+			PRINTF("failed to wait on the queues\n\r");
+			break;
+		}
+		if (osMessageQueueGet(queues[ready], &message, 0, 0) == osOK)
+			++received;
+	}
+
+	bench_sem_give(DONE_SEM);
+
+	bench_thread_exit();
+}
+
+/**
+ * @brief Put the messages and wait for the consumer to have them all
+ */
+static void gather_stats(const char *description)
+{
+	bench_time_t  start;
+	bench_time_t  end;
+
+	start = bench_timing_counter_get();
+
+	for (uint32_t i = 0; i < ITERATIONS; i++)
+		osMessageQueuePut(queues[i % NUM_QUEUES], &i, 0, osWaitForever);
+
+	bench_sem_take(DONE_SEM);
+
+	end = bench_timing_counter_get();
+
+	PRINTF(" %-40s: %6llu\n\r", description, bench_timing_cycles_to_ns(bench_timing_cycles_get(&start, &end)) / ITERATIONS);
+}
+
+/**
+ * @brief Test for the wait any benchmarking
+ */
+void bench_wait_any(void *arg)
+{
+	uint32_t stop = STOP_MESSAGE;
+
+	bench_timing_init();
+
+	bench_thread_set_priority(MAIN_PRIORITY);
+
+	bench_sem_create(DONE_SEM, 0, 1);
+
+	for (int i = 0; i < NUM_QUEUES; i++)
+		queues[i] = osMessageQueueNew(QUEUE_SIZE, sizeof(uint32_t), 0);
+	combined = osMessageQueueNew(QUEUE_SIZE, sizeof(uint32_t), 0);
+	if (!queues[0] || !queues[1] || !combined) {
+		PRINTF("failed to create the message queues\n\r");
+		return;
+	}
+
+	PRINTF("** Wait any stats [%d iterations] in nanoseconds **\n\r", ITERATIONS);
+
+	bench_timing_start();
+
+	/* Relays run at the consumer priority, so each message is forwarded as soon as it is put */
+	bench_thread_spawn(0, "consumer", CONSUMER_PRIORITY, bench_wait_any_relayed_consumer, 0);
+	for (int i = 0; i < NUM_QUEUES; i++)
+		bench_thread_spawn(i + 1, "relay", CONSUMER_PRIORITY, bench_wait_any_relay, queues[i]);
+	gather_stats("Relay threads and a combined queue");
+	for (int i = 0; i < NUM_QUEUES; i++)
+		osMessageQueuePut(queues[i], &stop, 0, osWaitForever);
+	bench_collect_resources();
+
+	bench_thread_spawn(0, "consumer", CONSUMER_PRIORITY, bench_wait_any_consumer, 0);
+	gather_stats("Wait any on the queues");
+	bench_collect_resources();
+
+	bench_timing_stop();
+
+	for (int i = 0; i < NUM_QUEUES; i++)
+		osMessageQueueDelete(queues[i]);
+	osMessageQueueDelete(combined);
+}
+
+#ifdef RUN_WAIT_ANY
+int main(void)
+{
+	PRINTF("\n\r *** Starting! ***\n\n\r");
+
+	bench_test_init(bench_wait_any);
+
+	PRINTF("\n\r *** Done! ***\n\r");
+
+	return 0;
+}
+#endif
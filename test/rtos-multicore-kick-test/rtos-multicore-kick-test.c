@@ -0,0 +1,148 @@
+/*
+ * Copyright (C) 2024 Stephen Street
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * rtos-multicore-kick-test.c
+ *
+ * Core 1 is woken from idle by a kick, then must still take a second kick while a hog keeps it busy
+ */
+
+#include <threads.h>
+#include <errno.h>
+#include <stdatomic.h>
+#include <stdio.h>
+
+#include <pico/toolkit/compiler.h>
+#include <pico/toolkit/scheduler.h>
+
+#include <hardware/gpio.h>
+#include <hardware/uart.h>
+
+#define UART_ID uart0
+#define BAUD_RATE 115200
+#define UART_TX_PIN 0
+#define UART_RX_PIN 1
+
+#define NUM_ROUNDS 20
+#define PREEMPT_TICKS 500
+
+int picolibc_putc(char c, FILE *file);
+int picolibc_getc(FILE *file);
+
+static atomic_bool hog_running = false;
+static atomic_bool hog_exit = false;
+static atomic_bool urgent_ran = false;
+
+int picolibc_putc(char c, FILE *file)
+{
+	if (c == '\n')
+		uart_putc(UART_ID, '\r');
+
+	uart_putc(UART_ID, c);
+
+	return c;
+}
+
+int picolibc_getc(FILE *file)
+{
+	return uart_getc(UART_ID);
+}
+
+__constructor void console_init(void)
+{
+	/* Set up our UART with the required speed. */
+	uart_init(UART_ID, BAUD_RATE);
+
+	/*
+	 * Set the TX and RX pins by using the function select on the GPIO
+	 * Set datasheet for more information on function select
+	 */
+	gpio_set_function(UART_TX_PIN, GPIO_FUNC_UART);
+	gpio_set_function(UART_RX_PIN, GPIO_FUNC_UART);
+}
+
+static int hog_thread(void *context)
+{
+	/* Never yields, only a kick gets anything else onto this core */
+	atomic_store(&hog_running, true);
+	while (!atomic_load(&hog_exit));
+
+	return 0;
+}
+
+static int urgent_thread(void *context)
+{
+	atomic_store(&urgent_ran, true);
+	return 0;
+}
+
+static int run_round(int round)
+{
+	thrd_attr_t hog_attr;
+	thrd_attr_t urgent_attr;
+	thrd_t hog;
+	thrd_t urgent;
+	int status = 0;
+
+	_thdr_attr_init(&hog_attr, SCHEDULER_CORE_AFFINITY, __THRD_PRIORITY, __THRD_STACK_SIZE, 1);
+	_thdr_attr_init(&urgent_attr, SCHEDULER_CORE_AFFINITY, __THRD_PRIORITY - 1, __THRD_STACK_SIZE, 1);
+
+	atomic_store(&hog_running, false);
+	atomic_store(&hog_exit, false);
+	atomic_store(&urgent_ran, false);
+
+	/* Core 1 is idle, creating the hog kicks it out of the idle loop */
+	if (_thrd_create(&hog, hog_thread, 0, &hog_attr) != thrd_success) {
+		printf("could not create hog thread: %d\n", errno);
+		return -1;
+	}
+	while (!atomic_load(&hog_running))
+		thrd_yield();
+
+	/* The second kick must preempt the hog */
+	if (_thrd_create(&urgent, urgent_thread, 0, &urgent_attr) != thrd_success) {
+		printf("could not create urgent thread: %d\n", errno);
+		atomic_store(&hog_exit, true);
+		thrd_join(hog, 0);
+		return -1;
+	}
+	unsigned long start = scheduler_get_ticks();
+	while (!atomic_load(&urgent_ran) && scheduler_get_ticks() - start < PREEMPT_TICKS)
+		thrd_yield();
+	if (!atomic_load(&urgent_ran)) {
+		printf("round %d: urgent thread did not preempt the hog\n", round);
+		status = -1;
+	}
+
+	/* Let core 1 go idle again */
+	atomic_store(&hog_exit, true);
+	thrd_join(urgent, 0);
+	thrd_join(hog, 0);
+
+	return status;
+}
+
+static int run_test(void)
+{
+	int status = 0;
+
+	for (int round = 0; round < NUM_ROUNDS && status == 0; ++round) {
+
+		/* Give core 1 time to reach its idle loop */
+		thrd_sleep(&(struct timespec){ .tv_sec = 0, .tv_nsec = 10000000 }, 0);
+
+		status = run_round(round);
+	}
+
+	printf("%s\n", status == 0 ? "passed" : "failed");
+
+	return status;
+}
+
+int main(int argc, char **argv)
+{
+	return run_test();
+}
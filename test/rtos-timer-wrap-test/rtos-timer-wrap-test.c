@@ -0,0 +1,179 @@
+/*
+ * Copyright (C) 2024 Stephen Street
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * rtos-timer-wrap-test.c
+ *
+ * Built with SCHEDULER_INITIAL_TICKS just short of a tick boundary, so the timeouts below straddle it
+ */
+
+#include <threads.h>
+#include <errno.h>
+#include <stdio.h>
+
+#include <pico/toolkit/compiler.h>
+#include <pico/toolkit/scheduler.h>
+
+#include <hardware/gpio.h>
+#include <hardware/uart.h>
+
+#define UART_ID uart0
+#define BAUD_RATE 115200
+#define UART_TX_PIN 0
+#define UART_RX_PIN 1
+
+#define NUM_WAITERS 3
+#define LONG_TIMEOUT 0x20000000UL
+#define SHORT_SLEEP 2000UL
+#define SLEEP_SLACK 100UL
+
+int picolibc_putc(char c, FILE *file);
+int picolibc_getc(FILE *file);
+
+static long wake_value = 0;
+static struct futex wake_futex;
+static struct task *waiter_tasks[NUM_WAITERS] = { 0 };
+
+static long deadline_value = 0;
+static struct futex deadline_futex;
+static unsigned long long deadline = 0;
+static unsigned long long deadline_woken = 0;
+
+int picolibc_putc(char c, FILE *file)
+{
+	if (c == '\n')
+		uart_putc(UART_ID, '\r');
+
+	uart_putc(UART_ID, c);
+
+	return c;
+}
+
+int picolibc_getc(FILE *file)
+{
+	return uart_getc(UART_ID);
+}
+
+__constructor void console_init(void)
+{
+	/* Set up our UART with the required speed. */
+	uart_init(UART_ID, BAUD_RATE);
+
+	/*
+	 * Set the TX and RX pins by using the function select on the GPIO
+	 * Set datasheet for more information on function select
+	 */
+	gpio_set_function(UART_TX_PIN, GPIO_FUNC_UART);
+	gpio_set_function(UART_RX_PIN, GPIO_FUNC_UART);
+}
+
+static int waiter_thread(void *context)
+{
+	int id = (int)context;
+
+	/* Long enough to land past the wrap of the 32-bit tick, the test wakes us well before then */
+	waiter_tasks[id] = scheduler_task();
+	return scheduler_futex_wait(&wake_futex, 0, LONG_TIMEOUT * (id + 1));
+}
+
+static int deadline_thread(void *context)
+{
+	/* Nobody wakes us, only the deadline */
+	int result = scheduler_futex_wait_until(&deadline_futex, 0, deadline);
+	deadline_woken = scheduler_get_ticks64();
+	return result;
+}
+
+static int long_timeout_test(void)
+{
+	thrd_t waiters[NUM_WAITERS];
+	int status = -1;
+
+	scheduler_futex_init(&wake_futex, &wake_value, 0);
+
+	/* Arm the long timeouts first */
+	for (int i = 0; i < NUM_WAITERS; ++i)
+		if (thrd_create(&waiters[i], waiter_thread, (void *)i) != thrd_success) {
+			printf("could not create waiter thread %d: %d\n", i, errno);
+			return -1;
+		}
+	for (int i = 0; i < NUM_WAITERS; ++i)
+		while (waiter_tasks[i] == 0 || scheduler_get_state(waiter_tasks[i]) != TASK_BLOCKED)
+			thrd_yield();
+
+	/* A short sleep across the boundary must not wait for any of the long timeouts */
+	unsigned long long start = scheduler_get_ticks64();
+	printf("sleeping %lu ticks from 0x%08lx\n", SHORT_SLEEP, (unsigned long)(uint32_t)start);
+	scheduler_sleep(SHORT_SLEEP);
+	unsigned long long slept = scheduler_get_ticks64() - start;
+	printf("slept %llu ticks\n", slept);
+	if (slept < SHORT_SLEEP || slept > SHORT_SLEEP + SLEEP_SLACK)
+		printf("short sleep was not on time\n");
+	else
+		status = 0;
+
+	/* Cancel the long timeouts, each waiter must see the wake and not a timeout */
+	wake_value = 1;
+	scheduler_futex_wake(&wake_futex, true);
+	for (int i = 0; i < NUM_WAITERS; ++i) {
+		int result;
+		thrd_join(waiters[i], &result);
+		if (result != 0) {
+			printf("waiter %d returned %d\n", i, result);
+			status = -1;
+		}
+	}
+
+	return status;
+}
+
+static int deadline_test(void)
+{
+	thrd_t waiter;
+	int status = 0;
+	int result;
+
+	scheduler_futex_init(&deadline_futex, &deadline_value, 0);
+
+	/* The same absolute deadline for a futex wait and a sleep */
+	deadline = scheduler_get_ticks64() + SHORT_SLEEP;
+	printf("waiting until 0x%llx\n", deadline);
+	if (thrd_create(&waiter, deadline_thread, 0) != thrd_success) {
+		printf("could not create deadline thread: %d\n", errno);
+		return -1;
+	}
+	scheduler_sleep_until(deadline);
+	unsigned long long woken = scheduler_get_ticks64();
+	thrd_join(waiter, &result);
+
+	printf("sleep woke at 0x%llx, wait woke at 0x%llx\n", woken, deadline_woken);
+	if (woken < deadline || woken > deadline + SLEEP_SLACK) {
+		printf("sleep until was not on time\n");
+		status = -1;
+	}
+	if (result != -ETIMEDOUT || deadline_woken < deadline || deadline_woken > deadline + SLEEP_SLACK) {
+		printf("wait until returned %d and was not on time\n", result);
+		status = -1;
+	}
+
+	return status;
+}
+
+static int run_test(void)
+{
+	int status = long_timeout_test();
+	if (deadline_test() != 0)
+		status = -1;
+
+	printf("%s\n", status == 0 ? "passed" : "failed");
+
+	return status;
+}
+
+int main(int argc, char **argv)
+{
+	return run_test();
+}